@@ -1,13 +1,16 @@
 // Buffer cache.
 //
 // The buffer cache is a linked list of buf structures holding
-// cached copies of disk block contents.  Caching disk blocks
+// cached copies of disk block contents, hashed by block number
+// for lookup.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
+// * To write many buffers at once, call bwritev.
+// * To have the flusher thread write a buffer later, call bdwrite.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
@@ -16,16 +19,37 @@
 
 #include "types.h"
 #include "param.h"
+#include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "slab.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
 
+// The cache grows and shrinks a page at a time. A page
+// holds the data of BPP buffers, whose struct bufs come
+// from a slab cache.
+
+// Most dirty buffers bflush() writes in one batch.
+#define NFLUSH 32
+
+// Most buffers the cache may hold: 1/BCACHEFRAC of RAM.
+#define MAXBUF (((PHYSTOP - KERNBASE) / BCACHEFRAC / PGSIZE) * BPP)
+
+#define NBHASH 1021  // lookup hash buckets
+
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct slabcache cache;
+  int nbuf;    // number of buffers allocated
+  uint hits;   // bget() found the block cached
+  uint misses; // bget() had to recycle a buffer
+
+  // Buffers that hold a block, by (dev, blockno), through
+  // hnext. New buffers have dev 0 and are in no chain.
+  struct buf *hash[NBHASH];
 
   // Linked list of all buffers, through prev/next.
   // Sorted by how recently the buffer was used.
@@ -33,59 +57,234 @@ struct {
   struct buf head;
 } bcache;
 
+static uint
+bhash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBHASH;
+}
+
+// Caller must hold bcache.lock.
+static struct buf*
+blookup(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.hash[bhash(dev, blockno)]; b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
+
+// Take b out of the hash, so it holds no block.
+// Caller must hold bcache.lock.
+static void
+bunhash(struct buf *b)
+{
+  struct buf **pp;
+
+  if(b->dev == 0)
+    return;
+  for(pp = &bcache.hash[bhash(b->dev, b->blockno)]; *pp != b; pp = &(*pp)->hnext)
+    ;
+  *pp = b->hnext;
+  b->dev = 0;
+}
+
+// Allocate a page of data for BPP new buffers, and their
+// struct bufs, linked in a ring through sib. Returns one of
+// them, or 0 if out of memory. kalloc() may call bshrink(),
+// so this must not be called with bcache.lock held.
+static struct buf*
+bnewpage(void)
+{
+  struct buf *b, *first, *last;
+  char *pg;
+  int i;
+
+  if((pg = kalloc()) == 0)
+    return 0;
+  first = last = 0;
+  for(i = 0; i < BPP; i++){
+    if((b = slaballoc(&bcache.cache)) == 0){
+      for(; first; first = b){
+        b = first->sib;
+        slabfree(&bcache.cache, first);
+      }
+      kfree(pg);
+      return 0;
+    }
+    memset(b, 0, sizeof(*b));
+    b->data = (uchar*)pg + i*BSIZE;
+    initsleeplock(&b->lock, "buffer");
+    b->sib = first;
+    first = b;
+    if(last == 0)
+      last = b;
+  }
+  last->sib = first;
+  return first;
+}
+
+// Add the buffers of a page from bnewpage() to the cache, as
+// the least recently used ones. Caller must hold bcache.lock.
+static void
+baddpage(struct buf *first)
+{
+  struct buf *b = first;
+
+  do {
+    b->prev = bcache.head.prev;
+    b->next = &bcache.head;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+    b = b->sib;
+  } while(b != first);
+  bcache.nbuf += BPP;
+}
+
 void
 binit(void)
 {
   struct buf *b;
 
   initlock(&bcache.lock, "bcache");
+  slabinit(&bcache.cache, "buf", sizeof(struct buf));
 
   // Create linked list of buffers
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+
+  // Start with NBUF buffers; the cache never shrinks below
+  // that, so the log can always pin a full transaction.
+  while(bcache.nbuf < NBUF){
+    if((b = bnewpage()) == 0)
+      panic("binit");
+    acquire(&bcache.lock);
+    baddpage(b);
+    release(&bcache.lock);
   }
 }
 
+// Free up to npages pages of buffers that no one is using,
+// least recently used first. Called by kalloc() when memory
+// runs short. Returns the number of pages freed.
+int
+bshrink(int npages)
+{
+  struct buf *b, *pb, *next;
+  char *pg;
+  int n;
+
+  acquire(&bcache.lock);
+  for(n = 0; n < npages && bcache.nbuf - BPP >= NBUF; n++){
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+      if(b->refcnt != 0 || b->dirty)
+        continue;
+      for(pb = b->sib; pb != b; pb = pb->sib)
+        if(pb->refcnt != 0 || pb->dirty)
+          break;
+      if(pb == b)
+        break;
+    }
+    if(b == &bcache.head)
+      break;  // every page has a buffer in use
+    pg = (char*)PGROUNDDOWN((uint64)b->data);
+    pb = b;
+    do {
+      next = pb->sib;
+      bunhash(pb);
+      pb->next->prev = pb->prev;
+      pb->prev->next = pb->next;
+      slabfree(&bcache.cache, pb);
+      pb = next;
+    } while(pb != b);
+    bcache.nbuf -= BPP;
+    kfree(pg);
+  }
+  release(&bcache.lock);
+  return n;
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct buf *b, *nb;
+  int grown = 0;
 
   acquire(&bcache.lock);
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
+  for(;;){
+    // Is the block already cached?
+    if((b = blookup(dev, blockno)) != 0){
       b->refcnt++;
+      bcache.hits++;
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
-  }
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+    // Not cached.
+    // Grow the cache by a page, unless it is at its limit or
+    // free memory is short. kalloc() may call bshrink(), so
+    // the lock is dropped around bnewpage(); look for the
+    // block again afterwards in case someone else cached it
+    // meanwhile.
+    if(!grown && bcache.nbuf + BPP <= MAXBUF && !kmemlow()){
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      nb = bnewpage();
+      acquire(&bcache.lock);
+      grown = 1;
+      if(nb){
+        baddpage(nb);
+        continue;
+      }
+    }
+
+    // Recycle the least recently used (LRU) unused buffer.
+    // Dirty buffers must be written before they can be reused.
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+      if(b->refcnt == 0 && !b->dirty) {
+        bunhash(b);
+        b->dev = dev;
+        b->blockno = blockno;
+        b->hnext = bcache.hash[bhash(dev, blockno)];
+        bcache.hash[bhash(dev, blockno)] = b;
+        b->valid = 0;
+        b->refcnt = 1;
+        bcache.misses++;
+        release(&bcache.lock);
+        acquiresleep(&b->lock);
+        return b;
+      }
     }
+
+    // Every buffer is in use. Grow past the point at which
+    // memory counts as short, if it isn't gone altogether.
+    if(grown || bcache.nbuf + BPP > MAXBUF)
+      panic("bget: no buffers");
+    release(&bcache.lock);
+    nb = bnewpage();
+    acquire(&bcache.lock);
+    if(nb == 0)
+      panic("bget: no buffers");
+    grown = 1;
+    baddpage(nb);
   }
-  panic("bget: no buffers");
+}
+
+// Hand the n locked bufs in b[] to the disk backend
+// chosen at build time, and wait for them.
+static void
+diskrw(struct buf **b, int n, int write)
+{
+#ifdef RAMDISK
+  ramdiskrw(b, n, write);
+#else
+  iosched_rw(b, n, write);
+#endif
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,19 +295,165 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    diskrw(&b, 1, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// Read or write the blocks of the page at data straight from
+// or to the disk, bypassing the cache: block blockno[i] is
+// data + i*BSIZE, and entries that are 0 are skipped. For the
+// page cache, which holds file data itself, and for swap.
+void
+bpagerw(uint dev, uint *blockno, uchar *data, int write)
+{
+  struct buf bufs[BPP], *b[BPP];
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < BPP; i++){
+    if(blockno[i] == 0)
+      continue;
+    memset(&bufs[n], 0, sizeof(bufs[n]));
+    initsleeplock(&bufs[n].lock, "pagebuf");
+    acquiresleep(&bufs[n].lock);  // the disk backends check
+    bufs[n].dev = dev;
+    bufs[n].blockno = blockno[i];
+    bufs[n].data = data + i*BSIZE;
+    b[n] = &bufs[n];
+    n++;
+  }
+  if(n > 0)
+    diskrw(b, n, write);
+  for(i = 0; i < n; i++)
+    releasesleep(&bufs[i].lock);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  diskrw(&b, 1, 1);
+  b->dirty = 0;
+}
+
+// Write the n locked bufs in b[] to disk, with as many writes
+// in flight at once as the disk allows. If b[] is sorted by
+// block number, neighbouring blocks go out as one write.
+void
+bwritev(struct buf **b, int n)
+{
+  for(int i = 0; i < n; i++){
+    if(!holdingsleep(&b[i]->lock))
+      panic("bwritev");
+  }
+  diskrw(b, n, 1);
+  for(int i = 0; i < n; i++)
+    b[i]->dirty = 0;
+}
+
+// Note that b's contents are newer than the disk's, and
+// leave the write to the flusher thread. Must be locked.
+// A dirty buffer stays in the cache until it is written.
+void
+bdwrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bdwrite");
+  if(!b->dirty){
+    b->dirty = 1;
+    b->dirtytick = ticks;
+  }
+}
+
+// Sort bufs by block number.
+static void
+sortbufs(struct buf **b, int n)
+{
+  int i, j;
+  struct buf *t;
+
+  for(i = 1; i < n; i++){
+    t = b[i];
+    for(j = i; j > 0 && b[j-1]->blockno > t->blockno; j--)
+      b[j] = b[j-1];
+    b[j] = t;
+  }
+}
+
+// Write dirty buffers to disk in sorted batches: those that
+// have been dirty for FLUSHAGE ticks, or all if all is set.
+// A buffer someone else holds is skipped rather than waited
+// for while holding the rest of the batch: the holder may be
+// bmap() or itrunc(), which lock an indirect block and then
+// a bitmap block with a lower number. With all set, skipped
+// buffers are then written one at a time.
+void
+bflush(int all)
+{
+  struct buf *b, *batch[NFLUSH], *w[NFLUSH], *busy[NFLUSH];
+  int i, n, nw, nbusy;
+
+  do {
+    n = 0;
+    acquire(&bcache.lock);
+    for(b = bcache.head.prev; b != &bcache.head && n < NFLUSH; b = b->prev){
+      if(b->dirty && (all || ticks - b->dirtytick >= FLUSHAGE)){
+        b->refcnt++;
+        batch[n++] = b;
+      }
+    }
+    release(&bcache.lock);
+
+    sortbufs(batch, n);
+    nw = nbusy = 0;
+    for(i = 0; i < n; i++){
+      if(!tryacquiresleep(&batch[i]->lock))
+        busy[nbusy++] = batch[i];
+      else if(batch[i]->dirty)  // someone may have written it meanwhile.
+        w[nw++] = batch[i];
+      else
+        brelse(batch[i]);
+    }
+    bwritev(w, nw);
+    for(i = 0; i < nw; i++)
+      brelse(w[i]);
+
+    for(i = 0; i < nbusy; i++){
+      b = busy[i];
+      if(all){
+        acquiresleep(&b->lock);
+        if(b->dirty)
+          bwrite(b);
+        brelse(b);
+      } else
+        bunpin(b);
+    }
+  } while(n == NFLUSH && n > nbusy);
+}
+
+// The flusher thread: writes aged dirty file pages and
+// buffers, and lets the log install committed transactions
+// while it is idle.
+void
+bflusher(void)
+{
+  uint ticks0;
+
+  for(;;){
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < FLUSHAGE/2)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    pflush(0);
+    bflush(0);
+    log_checkpoint(0);
+  }
 }
 
 // Release a locked buffer.
@@ -151,3 +496,26 @@ bunpin(struct buf *b) {
 }
 
 
+
+// Format the cache's size and hit rate into buf, for the
+// statistics device.
+int
+bstats(char *buf, int sz)
+{
+  uint hits, misses, nbuf, ndirty;
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  nbuf = bcache.nbuf;
+  hits = bcache.hits;
+  misses = bcache.misses;
+  ndirty = 0;
+  for(b = bcache.head.next; b != &bcache.head; b = b->next)
+    if(b->dirty)
+      ndirty++;
+  release(&bcache.lock);
+
+  return snprintf(buf, sz, "bcache: %d bufs (max %d), %d dirty, %d hits, %d misses, %d%% hit rate\n",
+                  nbuf, MAXBUF, ndirty, hits, misses,
+                  hits + misses == 0 ? 0 : (int)((uint64)hits * 100 / (hits + misses)));
+}
@@ -1,12 +1,22 @@
+// Blocks per page, for the page cache.
+#define BPP (PGSIZE / BSIZE)
+
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int dirty;   // newer than the disk? (see bdwrite)
+  uint dirtytick; // when it became dirty
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
-  uchar data[BSIZE];
+  struct buf *hnext; // lookup hash chain
+  uchar *data;      // BSIZE bytes, in a page shared with other bufs
+  struct buf *sib;  // next of the bufs sharing the page, in a ring
+  int queued;       // waiting in the I/O scheduler?
+  int qwrite;       // is the queued request a write?
+  struct buf *qnext; // I/O scheduler queue
 };
 
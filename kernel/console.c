@@ -58,14 +58,25 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
+  int i, r;
 
   acquire(&cons.lock);
-  for(i = 0; i < n; i++){
+  for(i = 0; i < n; ){
     char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
-      break;
+    if(either_copyin(&c, user_src, src+i, 1) == -1){
+      // perhaps swapped out, which can't be read back in
+      // under cons.lock: fault it in and retry.
+      if(!user_src)
+        break;
+      release(&cons.lock);
+      r = vmaprefault(src+i, 1, 0);
+      acquire(&cons.lock);
+      if(r < 0)
+        break;
+      continue;
+    }
     uartputc(c);
+    i++;
   }
   release(&cons.lock);
 
@@ -82,7 +93,7 @@ int
 consoleread(int user_dst, uint64 dst, int n)
 {
   uint target;
-  int c;
+  int c, r;
   char cbuf;
 
   target = n;
@@ -111,8 +122,19 @@ consoleread(int user_dst, uint64 dst, int n)
 
     // copy the input byte to the user-space buffer.
     cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
+    if(either_copyout(user_dst, dst, &cbuf, 1) == -1){
+      // as in consolewrite(); the byte goes back for
+      // whoever reads next.
+      cons.r--;
+      if(!user_dst)
+        break;
+      release(&cons.lock);
+      r = vmaprefault(dst, 1, 1);
+      acquire(&cons.lock);
+      if(r < 0)
+        break;
+      continue;
+    }
 
     dst++;
     --n;
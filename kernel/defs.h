@@ -2,10 +2,13 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
 struct proc;
+struct seg;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
 
@@ -14,8 +17,15 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bdwrite(struct buf*);
+void            bflush(int);
+void            bflusher(void);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(int);
+void            bpagerw(uint, uint*, uchar*, int);
+int             bstats(char*, int);
 
 // console.c
 void            consoleinit(void);
@@ -24,15 +34,22 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
+struct inode*   execdup(struct inode*);
+void            execput(struct inode*);
 
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
-int             fileread(struct file*, uint64, int n);
+int             fileread(struct file*, int, uint64, int n);
 int             filestat(struct file*, uint64 addr);
-int             filewrite(struct file*, uint64, int n);
+int             filewrite(struct file*, int, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepread(struct file*, int, uint64, int, uint);
+int             filepwrite(struct file*, int, uint64, int, uint);
 
 // fs.c
 void            fsinit(int);
@@ -53,41 +70,91 @@ int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
+uint            bmap(struct inode*, uint);
 
 // ramdisk.c
 void            ramdiskinit(void);
-void            ramdiskintr(void);
-void            ramdiskrw(struct buf*);
+void            ramdiskrw(struct buf**, int, int);
 
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void*           kalloc_pages(int);
+void            kfree_pages(void *, int);
+void*           kalloc_zero(void);
+int             kzeroidle(void);
+void*           kalloc_huge(void);
+void            kfree_huge(void *);
 void            kinit(void);
+int             kmemlow(void);
+int             kmemstats(char*, int);
+
+// slab.c
+void            slabinit(struct slabcache*, char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+int             slabstats(char*, int);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            log_checkpoint(int);
+int             log_inlog(uint);
+void            log_bfree(uint);
+int             log_isfreed(uint);
+int             logstats(char*, int);
+
+// pcache.c
+void            pinit(void);
+int             preadi(struct inode*, int, uint64, uint, uint);
+int             pwritei(struct inode*, int, uint64, uint, uint);
+void            pinval(struct inode*);
+uint64          pmap(struct inode*, uint);
+void            pmapdup(uint64, int);
+void            pwritable(uint64);
+void            punmap(uint64, int);
+uint64          ptextmap(struct inode*, uint);
+void            ptextdup(uint64);
+void            ptextunmap(uint64);
+void            pflush(int);
+void            pflushnew(void);
+int             pshrink(int);
+int             pstats(char*, int);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, int, uint64, int);
+int             pipewrite(struct pipe*, int, uint64, int);
+int             pipesetsize(struct pipe*, int);
+int             pipegetsize(struct pipe*);
+int             pipein(struct pipe*, struct file*, int);
+int             pipeout(struct pipe*, struct file*, int, int);
 
 // printf.c
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+
+// stats.c
+void            statsinit(void);
+
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             vfork(void);
+void            vforkdone(struct proc*);
+int             spawn(char*, char**, struct file**);
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+void            proc_freepagetable(pagetable_t, uint64, struct seg*);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
@@ -104,6 +171,8 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            kthread(void (*)(void), char*);
+uint64          kstackpa(uint64);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -111,6 +180,7 @@ void            swtch(struct context*, struct context*);
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
+int             holdingspin(void);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
@@ -118,6 +188,7 @@ void            pop_off(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
@@ -131,6 +202,13 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(int, struct superblock*);
+void*           ualloc(int);
+uint64          swapin(pagetable_t, uint64);
+void            swapfree(uint);
+int             swapstats(char*, int);
+
 // syscall.c
 int             argint(int, int*);
 int             argstr(int, char*, int);
@@ -158,30 +236,52 @@ void            kvminit(void);
 void            kvminithart(void);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
+int             kvmstats(char*, int);
+int             thpstats(char*, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
-uint64          uvmdealloc(pagetable_t, uint64, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, uint64);
-void            uvmfree(pagetable_t, uint64);
-void            uvmunmap(pagetable_t, uint64, uint64, int);
+uint64          uvmdealloc(pagetable_t, uint64, uint64, struct seg*);
+int             uvmcopy(pagetable_t, pagetable_t, uint64, struct seg*);
+void            uvmfree(pagetable_t, uint64, struct seg*);
+void            uvmunmap(pagetable_t, uint64, uint64, int, struct seg*);
 void            uvmclear(pagetable_t, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
+pte_t *         walkleaf(pagetable_t, uint64, int*);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 
+// vma.c
+uint64          vmamap(struct file*, uint64, int, int, uint);
+int             vmaunmap(uint64, uint64);
+uint64          vmafault(pagetable_t, uint64, int);
+int             vmaprefault(uint64, uint64, int);
+int             vmafork(struct proc*, struct proc*);
+void            vmaexit(struct proc*);
+uint64          vmabase(struct proc*);
+
 // plic.c
 void            plicinit(void);
 void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// iosched.c
+void            ioschedinit(void);
+void            iosched_rw(struct buf **, int, int);
+int             ioschedstats(char*, int);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwv(int, struct buf **, int, int);
+int             virtio_disk_queue(void);
 void            virtio_disk_intr(void);
+int             virtio_disk_stats(char*, int);
+int             virtio_disk_setmode(char*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -4,22 +4,39 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "stat.h"
 #include "defs.h"
 #include "elf.h"
 
 static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+static int sharable(struct inode *ip, struct proghdr *ph);
+static int flags2perm(int flags);
 
 int
 exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
+
+// Replace the user image of p, the current process or a new
+// one that spawn() is building, with the program path.
+// Returns argc, or -1 with p's image left as it was.
+int
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe = 0, *oldexe;
   struct proghdr ph;
+  struct seg seg[NSEG], *sg;
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+  struct trapframe *tf = 0, *oldtf = p->trapframe;
 
   begin_op();
 
@@ -35,10 +52,21 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
+  // a vfork()ed child has been using its parent's trapframe
+  // page; the new image gets one of its own.
+  if(p->vfork){
+    if((tf = (struct trapframe*)kalloc()) == 0)
+      goto bad;
+    *tf = *p->trapframe;
+    p->trapframe = tf;
+  }
+
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Load program into memory, or rather, only the parts of
+  // it that can't be left to be paged in as they're touched.
+  memset(seg, 0, sizeof(seg));
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -48,20 +76,51 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
-    sz = sz1;
-    if(ph.vaddr % PGSIZE != 0)
-      goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < sz)
       goto bad;
+    uint64 sz1, end;
+    if(nseg < NSEG && sharable(ip, &ph)){
+      // read-only text, to be mapped from the page cache.
+      if(ph.vaddr > sz){
+        if((sz1 = uvmalloc(pagetable, sz, ph.vaddr)) == 0)
+          goto bad;
+        sz = sz1;
+      }
+      sg = &seg[nseg++];
+      sg->va = ph.vaddr;
+      sg->len = ph.memsz;
+      sg->off = ph.off;
+      sg->perm = flags2perm(ph.flags) | PTE_TEXT;
+    } else {
+      // what comes from the file is read in now, but whole
+      // pages of zeroes after it, the bss, wait until touched.
+      end = ph.vaddr + ph.memsz;
+      if(nseg < NSEG && PGROUNDUP(ph.vaddr + ph.filesz) < end){
+        end = PGROUNDUP(ph.vaddr + ph.filesz);
+        sg = &seg[nseg++];
+        sg->va = end;
+        sg->len = ph.vaddr + ph.memsz - end;
+        sg->off = 0;
+        sg->perm = PTE_W|PTE_X|PTE_R|PTE_U;
+      }
+      if(end > sz){
+        if((sz1 = uvmalloc(pagetable, sz, end)) == 0)
+          goto bad;
+        sz = sz1;
+      }
+      if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+        goto bad;
+    }
+    sz = ph.vaddr + ph.memsz;
   }
+
+  // processes running the program pin it for paging in, and
+  // keep it from being opened for writing.
+  exe = execdup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
@@ -108,23 +167,38 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
+  // The old image's mmap()ed regions go with it.
+  vmaexit(p);
+
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->exe = exe;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  if(p->vfork)
+    vforkdone(p);
+  else
+    proc_freepagetable(oldpagetable, oldsz, p->seg);
+  memmove(p->seg, seg, sizeof(seg));
+  execput(oldexe);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
   if(pagetable)
-    proc_freepagetable(pagetable, sz);
+    proc_freepagetable(pagetable, sz, seg);
+  if(tf){
+    p->trapframe = oldtf;
+    kfree(tf);
+  }
   if(ip){
     iunlockput(ip);
     end_op();
   }
+  execput(exe);
   return -1;
 }
 
@@ -155,3 +229,46 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
   
   return 0;
 }
+
+// Can segment ph of ip be mapped from the page cache rather
+// than copied? Only if it's read-only, has nothing to be
+// zeroed, and lies page-aligned in the file.
+static int
+sharable(struct inode *ip, struct proghdr *ph)
+{
+  return ip->type == T_FILE && (ph->flags & ELF_PROG_FLAG_WRITE) == 0 &&
+         ph->filesz == ph->memsz && ph->off % PGSIZE == 0;
+}
+
+static int
+flags2perm(int flags)
+{
+  int perm = PTE_U;
+
+  if(flags & ELF_PROG_FLAG_READ)
+    perm |= PTE_R;
+  if(flags & ELF_PROG_FLAG_EXEC)
+    perm |= PTE_X;
+  return perm;
+}
+
+// Another process runs the program ip, which the caller
+// holds the lock of or already runs.
+struct inode*
+execdup(struct inode *ip)
+{
+  __sync_fetch_and_add(&ip->ntext, 1);
+  return idup(ip);
+}
+
+// A process no longer runs the program ip, if any.
+void
+execput(struct inode *ip)
+{
+  if(ip == 0)
+    return;
+  __sync_fetch_and_add(&ip->ntext, -1);
+  begin_op();
+  iput(ip);
+  end_op();
+}
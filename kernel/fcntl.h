@@ -3,3 +3,14 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// fcntl commands
+#define F_GETPIPE_SZ 1  // capacity of a pipe
+#define F_SETPIPE_SZ 2  // resize a pipe
+
+// mmap protections and flags
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+#define PROT_EXEC   0x4
+#define MAP_SHARED  0x01  // writes go back to the file
+#define MAP_PRIVATE 0x02  // writes stay in this process
@@ -9,38 +9,37 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "file.h"
 #include "stat.h"
+#include "uio.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct spinlock lock;   // protects each file's ref
+  struct slabcache cache; // where files come from
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  slabinit(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
+// Returns 0 if out of memory.
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,6 +71,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  slabfree(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -101,27 +101,113 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Fault in the cnt user buffers in iov[], writable if write
+// is set, before the caller takes an inode lock, under which
+// vmafault() won't read in mmap()ed files or program text.
+// Errors are left for the copy to report.
+static void
+prefault(struct iovec *iov, int cnt, int write)
+{
+  for(int i = 0; i < cnt; i++)
+    vmaprefault((uint64)iov[i].iov_base, iov[i].iov_len, write);
+}
+
+// Read the cnt buffers in iov[] from inode-backed file f,
+// starting at *off, and advance *off. The buffers are user
+// virtual addresses if user_dst is set, else kernel ones.
+// Locks the inode once for the whole vector.
+static int
+inoderead(struct file *f, int user_dst, struct iovec *iov, int cnt, uint *off)
+{
+  int i, r, total = 0;
+
+  if(user_dst)
+    prefault(iov, cnt, 1);
+  ilock(f->ip);
+  for(i = 0; i < cnt; i++){
+    r = readi(f->ip, user_dst, (uint64)iov[i].iov_base, *off, iov[i].iov_len);
+    if(r < 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    *off += r;
+    total += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  iunlock(f->ip);
+  return total;
+}
+
+// Write the cnt buffers in iov[] to inode-backed file f,
+// starting at *off, and advance *off. The buffers are user
+// virtual addresses if user_src is set, else kernel ones.
+static int
+inodewrite(struct file *f, int user_src, struct iovec *iov, int cnt, uint *off)
+{
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // file data goes through the page cache, not the
+  // log, so each block costs only its allocation.
+  // small buffers share a transaction and an ilock().
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  uint64 max = (MAXOPBLOCKS-1-1-2) * BSIZE;
+  uint64 n1, m;
+  uint64 done = 0;  // bytes of iov[i] written
+  int i = 0, n = 0, r = 0;
+
+  if(user_src)
+    prefault(iov, cnt, 0);
+  while(i < cnt && r >= 0){
+    begin_op();
+    ilock(f->ip);
+    for(n1 = 0; i < cnt && n1 < max; n1 += m){
+      m = iov[i].iov_len - done;
+      if(m > max - n1)
+        m = max - n1;
+      if((r = writei(f->ip, user_src, (uint64)iov[i].iov_base + done, *off, m)) > 0)
+        *off += r;
+      if(r != m){
+        r = -1;
+        break;
+      }
+      n += m;
+      done += m;
+      if(done == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+    }
+    iunlock(f->ip);
+    end_op();
+  }
+  return r < 0 ? -1 : n;
+}
+
 // Read from file f.
-// addr is a user virtual address.
+// addr is a user virtual address if user_dst is set,
+// else a kernel address.
 int
-fileread(struct file *f, uint64 addr, int n)
+fileread(struct file *f, int user_dst, uint64 addr, int n)
 {
   int r = 0;
 
-  if(f->readable == 0)
+  if(f->readable == 0 || n < 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, user_dst, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    r = devsw[f->major].read(user_dst, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    struct iovec v = { (void*)addr, n };
+    r = inoderead(f, user_dst, &v, 1, &f->off);
   } else {
     panic("fileread");
   }
@@ -130,49 +216,25 @@ fileread(struct file *f, uint64 addr, int n)
 }
 
 // Write to file f.
-// addr is a user virtual address.
+// addr is a user virtual address if user_src is set,
+// else a kernel address.
 int
-filewrite(struct file *f, uint64 addr, int n)
+filewrite(struct file *f, int user_src, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
-  if(f->writable == 0)
+  if(f->writable == 0 || n < 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, user_src, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
+    ret = devsw[f->major].write(user_src, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    struct iovec v = { (void*)addr, n };
+    ret = inodewrite(f, user_src, &v, 1, &f->off);
   } else {
     panic("filewrite");
   }
@@ -180,3 +242,74 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Read into the cnt user buffers in iov[] from file f.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, total = 0;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_INODE)
+    return inoderead(f, 1, iov, cnt, &f->off);
+
+  for(i = 0; i < cnt; i++){
+    r = fileread(f, 1, (uint64)iov[i].iov_base, iov[i].iov_len);
+    if(r < 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    total += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return total;
+}
+
+// Write the cnt user buffers in iov[] to file f.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, total = 0;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_INODE)
+    return inodewrite(f, 1, iov, cnt, &f->off);
+
+  for(i = 0; i < cnt; i++){
+    r = filewrite(f, 1, (uint64)iov[i].iov_base, iov[i].iov_len);
+    if(r < 0)
+      return -1;
+    total += r;
+  }
+  return total;
+}
+
+// Read from inode-backed file f at offset off, without
+// using or changing f's offset. addr is a user virtual address
+// if user_dst is set, else a kernel address.
+int
+filepread(struct file *f, int user_dst, uint64 addr, int n, uint off)
+{
+  struct iovec v = { (void*)addr, n };
+
+  if(f->readable == 0 || f->type != FD_INODE || n < 0)
+    return -1;
+  return inoderead(f, user_dst, &v, 1, &off);
+}
+
+// Write to inode-backed file f at offset off, without
+// using or changing f's offset. addr is a user virtual address
+// if user_src is set, else a kernel address.
+int
+filepwrite(struct file *f, int user_src, uint64 addr, int n, uint off)
+{
+  struct iovec v = { (void*)addr, n };
+
+  if(f->writable == 0 || f->type != FD_INODE || n < 0)
+    return -1;
+  return inodewrite(f, user_src, &v, 1, &off);
+}
@@ -17,6 +17,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -44,6 +45,9 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(dev, &sb);
+  if(WRITEBACK)
+    kthread(bflusher, "flusher");
 }
 
 // Zero a block.
@@ -60,9 +64,13 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a disk block, zeroed unless it is for the data of
+// a regular file. That goes through the page cache rather
+// than the log, so must not land on a block still in the log,
+// nor on one freed by the transaction not yet committed: the
+// page cache writes the data before the commit.
 static uint
-balloc(uint dev)
+balloc(uint dev, int data)
 {
   int b, bi, m;
   struct buf *bp;
@@ -73,10 +81,13 @@ balloc(uint dev)
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
+        if(data && (log_inlog(b + bi) || log_isfreed(b + bi)))
+          continue;
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        if(!data)
+          bzero(dev, b + bi);
         return b + bi;
       }
     }
@@ -99,6 +110,7 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  log_bfree(b);
   brelse(bp);
 }
 
@@ -162,8 +174,13 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
+// In-memory inodes come from a slab cache, as many as are in
+// use. Once unused (ip->ref is 0) an inode stays in memory,
+// with its contents, in case it is wanted again; beyond
+// NINODE unused ones, the least recently used is freed.
+//
+// The icache.lock spin-lock protects the list of icache
+// entries. Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
 //
@@ -173,18 +190,38 @@ bfree(int dev, uint b)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct slabcache cache;
+  int nunused;  // entries with ref 0
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used, head.prev least.
+  struct inode head;
 } icache;
 
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  slabinit(&icache.cache, "inode", sizeof(struct inode));
+  icache.head.prev = &icache.head;
+  icache.head.next = &icache.head;
+}
+
+static void
+iunlink(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+// Put ip at the front of the icache list.
+static void
+ifront(struct inode *ip)
+{
+  ip->next = icache.head.next;
+  ip->prev = &icache.head;
+  icache.head.next->prev = ip;
+  icache.head.next = ip;
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -242,31 +279,56 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, *nip = 0;
+  int tried = 0;
 
   acquire(&icache.lock);
 
-  // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
-      return ip;
+  for(;;){
+    // Is the inode already cached?
+    for(ip = icache.head.next; ip != &icache.head; ip = ip->next){
+      if(ip->dev == dev && ip->inum == inum){
+        if(ip->ref++ == 0)
+          icache.nunused--;
+        release(&icache.lock);
+        if(nip)
+          slabfree(&icache.cache, nip);
+        return ip;
+      }
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
-  }
+    if(tried)
+      break;
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+    // Not cached. slaballoc() may have to shrink the
+    // buffer and page caches, so the lock is dropped around
+    // it, as bget() does around bnewpage(); look for the
+    // inode again afterwards in case someone else cached it
+    // meanwhile.
+    release(&icache.lock);
+    nip = slaballoc(&icache.cache);
+    acquire(&icache.lock);
+    tried = 1;
+  }
 
-  ip = empty;
+  // Use the new entry, or recycle the least recently used
+  // unused one if memory has run out.
+  if((ip = nip) != 0){
+    memset(ip, 0, sizeof(*ip));
+    initsleeplock(&ip->lock, "inode");
+  } else {
+    for(ip = icache.head.prev; ip != &icache.head; ip = ip->prev)
+      if(ip->ref == 0)
+        break;
+    if(ip == &icache.head)
+      panic("iget: no inodes");
+    iunlink(ip);
+    icache.nunused--;
+  }
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ifront(ip);
   release(&icache.lock);
 
   return ip;
@@ -295,6 +357,8 @@ ilock(struct inode *ip)
     panic("ilock");
 
   acquiresleep(&ip->lock);
+  if(myproc())
+    myproc()->nilock++;
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
@@ -319,6 +383,8 @@ iunlock(struct inode *ip)
   if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
+  if(myproc())
+    myproc()->nilock--;
   releasesleep(&ip->lock);
 }
 
@@ -353,7 +419,17 @@ iput(struct inode *ip)
     acquire(&icache.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    iunlink(ip);
+    ifront(ip);
+    if(++icache.nunused > NINODE){
+      for(ip = icache.head.prev; ip->ref != 0; ip = ip->prev)
+        ;
+      iunlink(ip);
+      icache.nunused--;
+      slabfree(&icache.cache, ip);
+    }
+  }
   release(&icache.lock);
 }
 
@@ -374,15 +450,16 @@ iunlockput(struct inode *ip)
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
-static uint
+uint
 bmap(struct inode *ip, uint bn)
 {
   uint addr, *a;
   struct buf *bp;
+  int data = ip->type == T_FILE;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = balloc(ip->dev, data);
     return addr;
   }
   bn -= NDIRECT;
@@ -390,11 +467,11 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, 0);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = balloc(ip->dev, data);
       log_write(bp);
     }
     brelse(bp);
@@ -413,6 +490,10 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  // cached pages must not be written to the freed blocks.
+  if(ip->type == T_FILE)
+    pinval(ip);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -462,6 +543,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(ip->type == T_FILE)
+    return preadi(ip, user_dst, dst, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -490,15 +573,20 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+  if(ip->type == T_FILE){
+    // only the metadata of a regular file goes in the log.
+    off += pwritei(ip, user_src, src, off, n);
+  } else {
+    for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+        brelse(bp);
+        break;
+      }
+      log_write(bp);
       brelse(bp);
-      break;
     }
-    log_write(bp);
-    brelse(bp);
   }
 
   if(n > 0){
@@ -5,9 +5,12 @@
 #define ROOTINO  1   // root i-number
 #define BSIZE 1024  // block size
 
+#ifndef __ASSEMBLER__  // fsimg.S wants only BSIZE
+
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
 //                                          free bit map | data blocks]
+// and after the file system, [ swap ]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -20,6 +23,8 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint swapstart;    // Block number of first swap block
+  uint nswap;        // Number of swap blocks
 };
 
 #define FSMAGIC 0x10203040
@@ -58,3 +63,4 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+#endif
@@ -0,0 +1,190 @@
+//
+// Disk I/O scheduler, between the buffer cache and the disk
+// driver.
+//
+// There is a scheduler for each of the driver's queues, and a
+// process uses the one for the queue of the CPU it's on, so
+// CPUs with queues of their own don't contend. In each,
+// requests wait in a queue sorted by block number. Whichever
+// process finds the scheduler idle becomes its dispatcher: it
+// sweeps the queue upward from where the last batch ended
+// (C-LOOK), wrapping to the lowest block when nothing lies
+// ahead, and passes each batch to virtio_disk_rwv(), which
+// merges runs of consecutive blocks into single requests.
+// Meanwhile other processes' requests pile up in the queue
+// and go out sorted with the next batch. The dispatcher
+// gives up the job once its own requests are done.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+
+// Most bufs dispatched to the driver at once.
+#define NBATCH 32
+
+struct ioq {
+  struct spinlock lock;
+  struct buf *queue; // pending bufs, by dev, then blockno
+  int busy;          // is a process dispatching?
+  uint dev;          // where the last batch ended
+  uint blockno;
+
+  uint nreq;         // bufs dispatched
+  uint nbatch;       // batches dispatched
+  uint nmerged;      // bufs adjacent to the previous one in a batch
+} ioq[NCPU];         // indexed like the driver's queues
+
+void
+ioschedinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&ioq[i].lock, "iosched");
+}
+
+// Does buf a come before buf b on disk?
+static int
+before(struct buf *a, struct buf *b)
+{
+  return a->dev < b->dev || (a->dev == b->dev && a->blockno < b->blockno);
+}
+
+// Add b to q's queue, keeping it sorted.
+static void
+enqueue(struct ioq *q, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &q->queue; *pp && before(*pp, b); pp = &(*pp)->qnext)
+    ;
+  b->qnext = *pp;
+  *pp = b;
+  b->queued = 1;
+}
+
+// Take the next batch off q's queue: the queued bufs at or
+// above the position where the last batch ended, in order,
+// or from the lowest block if there are none.
+static int
+nextbatch(struct ioq *q, struct buf **batch)
+{
+  struct buf **pp;
+  int n;
+
+  for(pp = &q->queue; *pp; pp = &(*pp)->qnext){
+    if((*pp)->dev > q->dev ||
+       ((*pp)->dev == q->dev && (*pp)->blockno >= q->blockno))
+      break;
+  }
+  if(*pp == 0)
+    pp = &q->queue;  // wrap around
+
+  for(n = 0; n < NBATCH && *pp; n++){
+    batch[n] = *pp;
+    *pp = (*pp)->qnext;
+    batch[n]->qnext = 0;
+    if(n > 0 && batch[n]->qwrite == batch[n-1]->qwrite &&
+       batch[n]->dev == batch[n-1]->dev &&
+       batch[n]->blockno == batch[n-1]->blockno + 1)
+      q->nmerged++;
+  }
+  if(n > 0){
+    q->dev = batch[n-1]->dev;
+    q->blockno = batch[n-1]->blockno + 1;
+    q->nreq += n;
+    q->nbatch++;
+  }
+  return n;
+}
+
+// Send a batch to the disk through driver queue qn, writes
+// first, and wait for it. Each half stays in block order.
+static void
+dispatch(int qn, struct buf **batch, int n)
+{
+  struct buf *v[NBATCH];
+  int i, nv;
+
+  for(int write = 1; write >= 0; write--){
+    nv = 0;
+    for(i = 0; i < n; i++)
+      if(batch[i]->qwrite == write)
+        v[nv++] = batch[i];
+    if(nv > 0)
+      virtio_disk_rwv(qn, v, nv, write);
+  }
+}
+
+// Read or write the n locked bufs in b[], and return when
+// all of them are done. With IOSCHED off, the requests go
+// straight to the driver in the order given.
+void
+iosched_rw(struct buf **b, int n, int write)
+{
+  struct buf *batch[NBATCH];
+  struct ioq *q;
+  int i, m, qn;
+
+  // stick to one queue even if we move to another CPU.
+  qn = virtio_disk_queue();
+  if(!IOSCHED){
+    virtio_disk_rwv(qn, b, n, write);
+    return;
+  }
+  q = &ioq[qn];
+
+  acquire(&q->lock);
+  for(i = 0; i < n; i++){
+    b[i]->qwrite = write;
+    enqueue(q, b[i]);
+  }
+
+  for(i = 0; i < n; ){
+    if(!b[i]->queued){
+      i++;
+      continue;
+    }
+    if(q->busy){
+      sleep(q, &q->lock);
+      continue;
+    }
+
+    // dispatch until our own requests are done.
+    q->busy = 1;
+    while(b[i]->queued){
+      m = nextbatch(q, batch);
+      release(&q->lock);
+      dispatch(qn, batch, m);
+      acquire(&q->lock);
+      while(m > 0)
+        batch[--m]->queued = 0;
+      wakeup(q);
+    }
+    q->busy = 0;
+    wakeup(q);  // someone else's turn, if anything is queued
+  }
+  release(&q->lock);
+}
+
+int
+ioschedstats(char *buf, int sz)
+{
+  uint nreq = 0, nbatch = 0, nmerged = 0;
+  struct ioq *q;
+
+  for(q = ioq; q < &ioq[NCPU]; q++){
+    acquire(&q->lock);
+    nreq += q->nreq;
+    nbatch += q->nbatch;
+    nmerged += q->nmerged;
+    release(&q->lock);
+  }
+
+  return snprintf(buf, sz, "iosched: %d bufs in %d batches, %d merged\n",
+                  nreq, nbatch, nmerged);
+}
@@ -1,6 +1,34 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. A buddy allocator: hands out
+// blocks of 2^order contiguous 4096-byte pages,
+// aligned to their size, up to 2^MAXORDER pages.
+//
+// There's a list of free blocks of each order. An allocation
+// takes a block of the smallest order that has one, and
+// splits it in halves down to the order wanted, putting the
+// spare halves on their lists. A freed block joins its buddy,
+// the other half of the block they were split from, if that
+// is free too, and so on up. avail[] says which pages start
+// a free block, and of what order.
+//
+// Memory the allocator hasn't handed out yet is not on the
+// free lists at first: kinit() only sets a bump pointer at
+// the end of the kernel, and allocblock() moves memory above
+// it onto the free lists, one aligned block of up to
+// 2^MAXORDER pages at a time, when the lists run dry. So boot
+// doesn't touch every page of RAM.
+//
+// Apart from the free lists, a pool of up to ZEROPOOL pages
+// already filled with zeroes waits for kalloc_zero(). An idle
+// CPU's scheduler loop keeps it topped up with kzeroidle().
+// The pool's pages, linked through their first words, count
+// as free memory, and kalloc() takes them back when the free
+// lists run dry.
+//
+// A KDEBUG build fills freed and newly allocated blocks with
+// junk, to catch dangling references and uninitialized
+// memory.
 
 #include "types.h"
 #include "param.h"
@@ -9,74 +37,325 @@
 #include "riscv.h"
 #include "defs.h"
 
-void freerange(void *pa_start, void *pa_end);
-
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
+// Free memory counts as short below this many pages. Caches
+// stop growing then, and give pages back if kalloc() runs out.
+#define LOWPAGES ((PHYSTOP - KERNBASE) / PGSIZE / 64)
+
+// How many pages kalloc() asks the caches for at a time.
+#define NRECLAIM 32
+
+#define MAXORDER  10  // largest block, 4MB
+#define HUGEORDER  9  // a 2MB megapage
+
+#define NPAGES ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PN(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PA(pn) (KERNBASE + (uint64)(pn) * PGSIZE)
+
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run free[MAXORDER+1];  // heads of circular lists of free blocks
+  int nblock[MAXORDER+1];       // number of blocks on each
+  int nfree;                    // free pages, including above bump
+  uint64 bump;                  // memory from here up is untouched
+  struct run *zero;             // the pool of zeroed pages
+  int nzero;                    // how many
+  uchar avail[NPAGES];          // 1 + order of the free block a page starts, or 0
 } kmem;
 
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  for(int k = 0; k <= MAXORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
+  kmem.bump = PGROUNDUP((uint64)end);
+  kmem.nfree = (PHYSTOP - kmem.bump) / PGSIZE;
 }
 
-void
-freerange(void *pa_start, void *pa_end)
+static void
+push(struct run *r, int order)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  struct run *head = &kmem.free[order];
+
+  r->next = head->next;
+  r->prev = head;
+  head->next->prev = r;
+  head->next = r;
+  kmem.nblock[order]++;
+  kmem.avail[PN(r)] = order + 1;
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
-void
-kfree(void *pa)
+static void
+unlink(struct run *r, int order)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.nblock[order]--;
+  kmem.avail[PN(r)] = 0;
+}
+
+// Put the block of 2^order pages at pa on the free lists,
+// joining it with its buddy for as long as the buddy is free.
+// Caller holds kmem.lock.
+static void
+freeblock(uint64 pa, int order)
+{
+  uint64 pn, bn;
+
+  pn = PN(pa);
+  for(; order < MAXORDER; order++){
+    bn = pn ^ (1L << order);
+    if(bn >= NPAGES || kmem.avail[bn] != order + 1)
+      break;
+    unlink((struct run*)PA(bn), order);
+    pn &= ~(1L << order);
+  }
+  push((struct run*)PA(pn), order);
+}
+
+// Move the largest aligned block that starts at the bump
+// pointer onto the free lists. Returns 0 if all memory has
+// been. Caller holds kmem.lock.
+static int
+bumpmore(void)
+{
+  int k;
+
+  if(kmem.bump + PGSIZE > PHYSTOP)
+    return 0;
+  for(k = MAXORDER; k > 0; k--)
+    if(PN(kmem.bump) % (1L << k) == 0 && kmem.bump + (PGSIZE << k) <= PHYSTOP)
+      break;
+  freeblock(kmem.bump, k);
+  kmem.bump += PGSIZE << k;
+  return 1;
+}
+
+// Take a block of 2^order pages off the free lists, splitting
+// a larger one if need be, and taking more memory from above
+// the bump pointer if none is big enough. Returns 0 if
+// there's none. Caller holds kmem.lock.
+static struct run*
+allocblock(int order)
 {
   struct run *r;
+  int k;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
-    panic("kfree");
+  for(;;){
+    for(k = order; k <= MAXORDER; k++)
+      if(kmem.free[k].next != &kmem.free[k])
+        break;
+    if(k <= MAXORDER)
+      break;
+    if(bumpmore() == 0)
+      return 0;
+  }
+  r = kmem.free[k].next;
+  unlink(r, k);
+  while(k > order){
+    k--;
+    push((struct run*)((char*)r + (PGSIZE << k)), k);
+  }
+  return r;
+}
+
+// Free the 2^order pages of physical memory at pa, which
+// kalloc_pages(order) returned. Its pages may also be freed
+// one at a time, or in smaller aligned blocks.
+void
+kfree_pages(void *pa, int order)
+{
+  uint64 sz = PGSIZE << order;
 
-  // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  if(order < 0 || order > MAXORDER || ((uint64)pa % sz) != 0 ||
+     (char*)pa < end || (uint64)pa + sz > kmem.bump)
+    panic("kfree");
 
-  r = (struct run*)pa;
+  if(KDEBUG)
+    memset(pa, 1, sz); // fill with junk to catch dangling refs
 
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  freeblock((uint64)pa, order);
+  kmem.nfree += 1 << order;
   release(&kmem.lock);
 }
 
+// Put the zeroed pool's pages back on the free lists.
+// Returns how many there were. Caller holds kmem.lock.
+static int
+zdrain(void)
+{
+  struct run *r;
+  int n;
+
+  for(n = 0; (r = kmem.zero) != 0; n++){
+    kmem.zero = r->next;
+    freeblock((uint64)r, 0);
+  }
+  kmem.nfree += n;
+  kmem.nzero = 0;
+  return n;
+}
+
+// Allocate 2^order contiguous pages of physical memory,
+// aligned to their size. Returns 0 if the memory cannot be
+// allocated. If no block is big enough, takes back the zeroed
+// pool, and then pages from the buffer and page caches, so
+// must not be called with bcache.lock or pcache.lock held.
+void *
+kalloc_pages(int order)
+{
+  struct run *r;
+  int tries;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  for(tries = 0; ; tries++){
+    acquire(&kmem.lock);
+    if((r = allocblock(order)) == 0 && zdrain() > 0)
+      r = allocblock(order);
+    if(r)
+      kmem.nfree -= 1 << order;
+    release(&kmem.lock);
+
+    if(r || tries > 0 || bshrink(NRECLAIM) + pshrink(NRECLAIM) == 0)
+      break;
+  }
+
+  if(r && KDEBUG)
+    memset((char*)r, 5, PGSIZE << order); // fill with junk
+  return (void*)r;
+}
+
+// Free the page of physical memory pointed at by v,
+// which should have been returned by a call to kalloc().
+void
+kfree(void *pa)
+{
+  kfree_pages(pa, 0);
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 void *
 kalloc(void)
+{
+  return kalloc_pages(0);
+}
+
+// Allocate a page of zeroes: one from the pool if there is
+// one ready, else a new page zeroed now.
+void *
+kalloc_zero(void)
 {
   struct run *r;
 
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  if((r = kmem.zero) != 0){
+    kmem.zero = r->next;
+    kmem.nzero--;
+  }
   release(&kmem.lock);
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  if(r){
+    r->next = 0;  // the link was its only non-zero word
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
   return (void*)r;
 }
+
+// Called by the scheduler on a CPU with nothing to run: zero
+// a free page for the pool, if the pool is short of ZEROPOOL
+// and free memory isn't short. Returns 1 if it did.
+int
+kzeroidle(void)
+{
+  struct run *r = 0;
+
+  // an unlocked look first, since idle CPUs call this in a
+  // loop; a stale answer only delays the next page.
+  if(kmem.nzero >= ZEROPOOL)
+    return 0;
+  acquire(&kmem.lock);
+  if(kmem.nzero < ZEROPOOL && kmem.nfree > LOWPAGES && (r = allocblock(0)) != 0)
+    kmem.nfree--;
+  release(&kmem.lock);
+  if(r == 0)
+    return 0;
+
+  memset((char*)r, 0, PGSIZE);
+  acquire(&kmem.lock);
+  r->next = kmem.zero;
+  kmem.zero = r;
+  kmem.nzero++;
+  release(&kmem.lock);
+  return 1;
+}
+
+// Allocate a 2MB block for a user megapage. Returns 0 if
+// there's none free, or if taking one would leave free memory
+// short. Doesn't reclaim cache pages as kalloc_pages() does:
+// the caller can use 4KB pages instead.
+void *
+kalloc_huge(void)
+{
+  struct run *r = 0;
+
+  acquire(&kmem.lock);
+  if(kmem.nfree - (1 << HUGEORDER) >= LOWPAGES && (r = allocblock(HUGEORDER)) != 0)
+    kmem.nfree -= 1 << HUGEORDER;
+  release(&kmem.lock);
+
+  if(r && KDEBUG)
+    memset((char*)r, 5, HUGEPGSIZE); // fill with junk
+  return (void*)r;
+}
+
+// Free a block that kalloc_huge() returned, all in one piece.
+void
+kfree_huge(void *pa)
+{
+  kfree_pages(pa, HUGEORDER);
+}
+
+// Is free memory short? Caches that grow on demand
+// check this before taking another page.
+int
+kmemlow(void)
+{
+  return kmem.nfree + kmem.nzero < LOWPAGES;
+}
+
+// Format the free lists into buf, for the statistics device:
+// the number of free blocks of each order, and how much of
+// the free memory is in pieces too small for a megapage.
+int
+kmemstats(char *buf, int sz)
+{
+  int n, k, small;
+
+  acquire(&kmem.lock);
+  n = snprintf(buf, sz, "kmem: %d pages free, %d untouched, %d zeroed, blocks by order",
+               kmem.nfree, (int)((PHYSTOP - kmem.bump) / PGSIZE), kmem.nzero);
+  small = 0;
+  for(k = 0; k <= MAXORDER; k++){
+    n += snprintf(buf + n, sz - n, " %d", kmem.nblock[k]);
+    if(k < HUGEORDER)
+      small += kmem.nblock[k] << k;
+  }
+  n += snprintf(buf + n, sz - n, ", %d%% in blocks under 2MB\n",
+                kmem.nfree ? small * 100 / kmem.nfree : 0);
+  release(&kmem.lock);
+  return n;
+}
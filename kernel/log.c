@@ -29,6 +29,18 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Writing committed blocks to their home locations (a
+// checkpoint) can be put off. With WRITEBACK, a commit just
+// marks the home blocks dirty and leaves them in the log;
+// later transactions append after them, logging a new copy of
+// any block they change again. The flusher thread writes the
+// dirty blocks in the background, and the log is emptied once
+// they are all written and no FS system call is active, or
+// when begin_op() needs the space. Until then, recovery
+// replays every committed transaction in order, so writing a
+// home block early, even one that a still-uncommitted call
+// has since changed, can never leave the disk inconsistent.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -42,14 +54,25 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // in commit() or checkpoint(), please wait.
+  int committed;   // lh.block[0..committed-1] are committed.
   int dev;
   struct logheader lh;
+  uint ncommit;     // transactions committed
+  uint ncheckpoint; // checkpoints that installed something
 };
 struct log log;
 
+// Blocks that the transaction not yet committed has freed.
+// On disk they still belong to their old files until it
+// commits, so file data, which is written before the commit,
+// must not go to them. Only touched with the block's bitmap
+// buffer locked, or by commit().
+static uchar freed[FSSIZE/8 + 1];
+
 static void recover_from_log(void);
 static void commit();
+static void checkpoint();
 
 void
 initlog(int dev, struct superblock *sb)
@@ -64,20 +87,64 @@ initlog(int dev, struct superblock *sb)
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// The home blocks are locked in block order and written as
+// one sorted batch rather than one synchronous write at a time.
+// A block logged more than once is installed from its last copy.
 static void
-install_trans(void)
+install_trans(int recovering)
 {
-  int tail;
+  struct buf *dbuf[LOGSIZE], *wbuf[LOGSIZE];
+  int slot[LOGSIZE];
+  int tail, i, j, k, n, nb, nw;
+
+  for(tail = 0; tail < log.lh.n; tail += n){
+    // after a commit the home blocks are still pinned in the
+    // cache and already hold the logged contents. recovery
+    // must read them from the log, and does a few at a time
+    // to leave buffers free for the log blocks.
+    n = log.lh.n - tail;
+    if(recovering && n > NBUF/2)
+      n = NBUF/2;
+
+    // pick the log slots to install, sorted by home block.
+    nb = 0;
+    for(i = tail; i < tail + n; i++){
+      for(j = i + 1; j < log.lh.n; j++)
+        if(log.lh.block[j] == log.lh.block[i])
+          break;
+      if(j < log.lh.n)
+        continue;  // a later copy supersedes this one
+      for(k = nb; k > 0 && log.lh.block[slot[k-1]] > log.lh.block[i]; k--)
+        slot[k] = slot[k-1];
+      slot[k] = i;
+      nb++;
+    }
+
+    nw = 0;
+    for(k = 0; k < nb; k++){
+      dbuf[k] = bread(log.dev, log.lh.block[slot[k]]); // read dst
+      if(recovering){
+        struct buf *lbuf = bread(log.dev, log.start+slot[k]+1); // read log block
+        memmove(dbuf[k]->data, lbuf->data, BSIZE);  // copy block to dst
+        brelse(lbuf);
+      }
+      // the flusher may already have written it.
+      if(recovering || dbuf[k]->dirty)
+        wbuf[nw++] = dbuf[k];
+    }
+    bwritev(wbuf, nw);  // write dsts to disk
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+    if(!recovering){
+      // log_write() pinned the block once per copy.
+      for(i = tail; i < tail + n; i++){
+        for(k = 0; dbuf[k]->blockno != log.lh.block[i]; k++)
+          ;
+        bunpin(dbuf[k]);
+      }
+    }
+    for(k = 0; k < nb; k++)
+      brelse(dbuf[k]);
   }
 }
 
@@ -116,7 +183,7 @@ static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(); // if committed, copy from log to disk
+  install_trans(1); // if committed, copy from log to disk
   log.lh.n = 0;
   write_head(); // clear the log
 }
@@ -130,8 +197,19 @@ begin_op(void)
     if(log.committing){
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      if(log.outstanding == 0){
+        // committed transactions fill the log;
+        // install them to make room.
+        log.committing = 1;
+        release(&log.lock);
+        checkpoint();
+        acquire(&log.lock);
+        log.committing = 0;
+        wakeup(&log);
+      } else {
+        // this op might exhaust log space; wait for commit.
+        sleep(&log, &log.lock);
+      }
     } else {
       log.outstanding += 1;
       release(&log.lock);
@@ -179,7 +257,7 @@ write_log(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
+  for (tail = log.committed; tail < log.lh.n; tail++) {
     struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
@@ -189,18 +267,111 @@ write_log(void)
   }
 }
 
+// Mark the home blocks of the transaction just committed
+// dirty, for checkpoint() or the flusher thread to write.
+static void
+dirty_trans(void)
+{
+  int tail;
+
+  for (tail = log.committed; tail < log.lh.n; tail++) {
+    struct buf *b = bread(log.dev, log.lh.block[tail]); // pinned, so cached
+    bdwrite(b);
+    brelse(b);
+  }
+}
+
 static void
 commit()
 {
-  if (log.lh.n > 0) {
+  if (log.lh.n > log.committed) {
+    pflushnew();     // Write file data in blocks newly allocated
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+    dirty_trans();   // Home locations are now out of date
+    log.committed = log.lh.n;
+    log.ncommit++;
+    memset(freed, 0, sizeof(freed));
+  }
+  if (!WRITEBACK)
+    checkpoint();    // Install writes to home locations now
+}
+
+// Install all committed transactions to their home locations,
+// then empty the log. The caller must have set log.committing,
+// with no FS system calls outstanding.
+static void
+checkpoint()
+{
+  if (log.committed > 0) {
+    install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    log.committed = 0;
+    write_head();    // Erase the transactions from the log
+    log.ncheckpoint++;
   }
 }
 
+// Bring home locations up to date and empty the log. If wait
+// is set, first waits for FS system calls in progress to end;
+// otherwise does nothing unless the log is idle.
+void
+log_checkpoint(int wait)
+{
+  acquire(&log.lock);
+  while(log.committing || log.outstanding > 0){
+    if(!wait){
+      release(&log.lock);
+      return;
+    }
+    sleep(&log, &log.lock);
+  }
+  if(log.committed == 0){
+    release(&log.lock);
+    return;
+  }
+  log.committing = 1;
+  release(&log.lock);
+
+  checkpoint();
+
+  acquire(&log.lock);
+  log.committing = 0;
+  wakeup(&log);
+  release(&log.lock);
+}
+
+// Is block blockno in the log, committed or not? Such a block
+// may yet be overwritten with its logged contents, so it must
+// not be given to file data, which bypasses the log.
+int
+log_inlog(uint blockno)
+{
+  int i, r = 0;
+
+  acquire(&log.lock);
+  for(i = 0; i < log.lh.n; i++)
+    if(log.lh.block[i] == blockno)
+      r = 1;
+  release(&log.lock);
+  return r;
+}
+
+// Block blockno has been freed by the running transaction.
+void
+log_bfree(uint blockno)
+{
+  if(blockno < FSSIZE)
+    freed[blockno/8] |= 1 << (blockno % 8);
+}
+
+// Has the running transaction freed block blockno?
+int
+log_isfreed(uint blockno)
+{
+  return blockno < FSSIZE && (freed[blockno/8] & (1 << (blockno % 8)));
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
 // commit()/write_log() will do the disk write.
@@ -221,7 +392,9 @@ log_write(struct buf *b)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
+  // log absorbtion, within the current transaction only:
+  // a committed copy must stay as it is until installed.
+  for (i = log.committed; i < log.lh.n; i++) {
     if (log.lh.block[i] == b->blockno)   // log absorbtion
       break;
   }
@@ -233,3 +406,22 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+// Format the log's state into buf, for the statistics device:
+// committed blocks still waiting to be checkpointed to their
+// home locations, and totals.
+int
+logstats(char *buf, int sz)
+{
+  int n, committed;
+  uint ncommit, ncheckpoint;
+
+  acquire(&log.lock);
+  n = log.lh.n;
+  committed = log.committed;
+  ncommit = log.ncommit;
+  ncheckpoint = log.ncheckpoint;
+  release(&log.lock);
+
+  return snprintf(buf, sz, "log: %d blocks, %d committed, %d commits, %d checkpoints\n",
+                  n, committed, ncommit, ncheckpoint);
+}
@@ -11,12 +11,17 @@ void
 main()
 {
   if(cpuid() == 0){
+    uint64 t0, t1, t2;
+
+    t0 = r_time();
     consoleinit();
     printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
+    t1 = r_time();
     kinit();         // physical page allocator
+    t2 = r_time();
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
@@ -25,10 +30,20 @@ main()
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pinit();         // page cache
+    ioschedinit();   // disk request scheduler
     iinit();         // inode cache
     fileinit();      // file table
+    pipeinit();      // pipe structures
+    statsinit();     // statistics device
+#ifdef RAMDISK
+    ramdiskinit();   // file system image in memory
+#else
     virtio_disk_init(); // emulated hard disk
+#endif
     userinit();      // first user process
+    printf("boot: main took %dus, kinit %dus\n",
+           (int)((r_time() - t0) / TIMEPERUS), (int)((t2 - t1) / TIMEPERUS));
     __sync_synchronize();
     started = 1;
   } else {
@@ -1,13 +1,33 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // unused i-nodes kept in memory
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (MAXOPBLOCKS*3)  // min size of disk block cache
+#define BCACHEFRAC   16  // disk block cache may use 1/BCACHEFRAC of RAM
+#define PCACHEFRAC    4  // file page cache may use 1/PCACHEFRAC of RAM
+#define WRITEBACK     1  // defer writing committed blocks home
+#define FLUSHAGE     30  // ticks a buffer may stay dirty
+#define IOSCHED       1  // sort and merge disk requests
+#ifndef SUPERPAGE
+#define SUPERPAGE     1  // map the kernel's RAM with 2MB/1GB pages
+#endif
+#define THP           1  // map whole aligned 2MB of user heap with a megapage
+#define ZEROPOOL    128  // pre-zeroed pages the idle loop keeps ready
+#ifndef KDEBUG
+#define KDEBUG        0  // fill free and new memory with junk
+#endif
+#ifndef DISKMODE
+#define DISKMODE      2  // disk completions at boot: 0 interrupt, 1 poll, 2 hybrid
+#endif
 #define FSSIZE       1000  // size of file system in blocks
+#define NSWAP       32768  // blocks of swap space after the file system
 #define MAXPATH      128   // maximum file path name
+#define MAXPIPE      65536 // maximum pipe capacity, a power of two
+#define MAXIOV       16    // maximum buffers in a readv/writev vector
+#define NVMA         16    // mmap regions per process
+#define NSEG         4     // program segments paged in on demand, per process
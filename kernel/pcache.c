@@ -0,0 +1,695 @@
+// Page cache.
+//
+// The data of regular files is cached a whole page at a time,
+// by inode and page number within the file, apart from the
+// buffer cache, which is left with the file system's metadata:
+// inodes, bitmaps, indirect blocks, directories and the log.
+// readi() and writei() copy to and from these pages, and
+// mmap(MAP_SHARED) maps them straight into processes, so a
+// file's data is cached once however it is used.
+//
+// File data does not go through the log. writei() allocates
+// blocks as part of its transaction, as before, and records
+// in the page which blocks it occupies; the flusher thread
+// later writes dirty pages straight to those blocks. sync()
+// writes them all. A page given new blocks is written before
+// the transaction that allocated them commits, so that after
+// a crash a file never holds a block's previous contents,
+// perhaps another file's; overwrites of blocks a file already
+// had may be lost.
+//
+// Interface:
+// * preadi() and pwritei() do readi() and writei() for
+//   regular files.
+// * pmap() returns a page for a shared mapping, pmapdup(),
+//   pwritable() and punmap() track what mappings do with it.
+// * ptextmap(), ptextdup() and ptextunmap() do the same for
+//   exec(), which maps read-only program text straight from
+//   here, so that every process running a program shares one
+//   copy. Writing the file gives it new pages and leaves the
+//   old ones to the processes already running it.
+// * pinval() drops a file's pages before its blocks are
+//   freed.
+// * pflush() writes dirty pages; pshrink() frees clean ones
+//   when memory runs short.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "file.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+// Most pages the cache may hold: 1/PCACHEFRAC of RAM.
+#define NPAGE ((PHYSTOP - KERNBASE) / PCACHEFRAC / PGSIZE)
+
+#define NPHASH 127  // lookup hash buckets
+
+// Most dirty pages pflush() takes at once.
+#define NFLUSH 32
+
+struct page {
+  uint dev;
+  uint inum;           // 0 if the page belongs to no file
+  uint pgno;           // page number within the file
+  char *data;          // PGSIZE bytes, or 0 if none
+  int valid;           // has data been read from disk?
+  int dirty;           // newer than the disk?
+  int fresh;           // has blocks the next commit allocates
+  uint dirtytick;      // when it became dirty
+  int ref;             // users, and user mappings
+  int wmap;            // writable user mappings
+  int tmap;            // mappings as program text
+  uint fseq;           // last pflush() to take it
+  uint blockno[BPP];   // where the data goes on disk; 0 past EOF
+  struct sleeplock lock;
+  struct page *prev;   // LRU list of pages with data
+  struct page *next;   // ... or the list of those without
+  struct page *hnext;  // lookup hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct page page[NPAGE];
+  struct page *hash[NPHASH];
+  struct page *free;  // descriptors without data
+  int npage;          // pages with data
+  uint fseq;          // pflush() calls so far
+  uint hits;
+  uint misses;
+  uint ntextcopy;     // text pages replaced by writes
+
+  // Pages with data, most recently used first.
+  struct page head;
+} pcache;
+
+// The page descriptor of each physical page the cache
+// holds, for mappings, which know only physical addresses.
+static struct page *bypa[(PHYSTOP - KERNBASE) / PGSIZE];
+
+#define PA2IDX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+void
+pinit(void)
+{
+  struct page *pg;
+
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(pg = pcache.page; pg < &pcache.page[NPAGE]; pg++){
+    initsleeplock(&pg->lock, "page");
+    pg->next = pcache.free;
+    pcache.free = pg;
+  }
+}
+
+static uint
+phash(uint dev, uint inum, uint pgno)
+{
+  return (dev * 31 + inum * 17 + pgno) % NPHASH;
+}
+
+// Caller must hold pcache.lock.
+static struct page*
+lookup(uint dev, uint inum, uint pgno)
+{
+  struct page *pg;
+
+  for(pg = pcache.hash[phash(dev, inum, pgno)]; pg; pg = pg->hnext)
+    if(pg->dev == dev && pg->inum == inum && pg->pgno == pgno)
+      return pg;
+  return 0;
+}
+
+// Take pg out of the hash, so it belongs to no file.
+// Caller must hold pcache.lock.
+static void
+unhash(struct page *pg)
+{
+  struct page **pp;
+
+  if(pg->inum == 0)
+    return;
+  for(pp = &pcache.hash[phash(pg->dev, pg->inum, pg->pgno)]; *pp != pg; pp = &(*pp)->hnext)
+    ;
+  *pp = pg->hnext;
+  pg->inum = 0;
+}
+
+// Caller must hold pcache.lock.
+static void
+lrufront(struct page *pg)
+{
+  pg->next = pcache.head.next;
+  pg->prev = &pcache.head;
+  pcache.head.next->prev = pg;
+  pcache.head.next = pg;
+}
+
+static void
+lruremove(struct page *pg)
+{
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+}
+
+// Write pg's data to its blocks. Must be locked. A page
+// that a process has mapped writable stays dirty, since
+// the process may change it again at any time.
+static void
+pgwrite(struct page *pg)
+{
+  acquire(&pcache.lock);
+  pg->dirty = pg->wmap > 0;
+  if(pg->dirty)
+    pg->dirtytick = ticks;
+  pg->fresh = 0;
+  release(&pcache.lock);
+  bpagerw(pg->dev, pg->blockno, (uchar*)pg->data, 1);
+}
+
+// Return the locked page pgno of inode (dev, inum), not
+// necessarily valid. Takes a fresh page unless memory is
+// short, else recycles the least recently used clean page
+// that no one is using, writing one first if need be.
+static struct page*
+pget(uint dev, uint inum, uint pgno)
+{
+  struct page *pg;
+  char *mem = 0;
+
+  acquire(&pcache.lock);
+  for(;;){
+    if((pg = lookup(dev, inum, pgno)) != 0){
+      pg->ref++;
+      pcache.hits++;
+      release(&pcache.lock);
+      if(mem)
+        kfree(mem);
+      acquiresleep(&pg->lock);
+      return pg;
+    }
+
+    // kalloc() may call pshrink(), so the lock is dropped
+    // around it; look for the page again afterwards.
+    if(mem == 0 && pcache.free && !kmemlow()){
+      release(&pcache.lock);
+      mem = kalloc();
+      acquire(&pcache.lock);
+      if(mem)
+        continue;
+    }
+    if(mem && pcache.free){
+      pg = pcache.free;
+      pcache.free = pg->next;
+      pg->data = mem;
+      mem = 0;
+      bypa[PA2IDX(pg->data)] = pg;
+      pcache.npage++;
+      lrufront(pg);
+      break;
+    }
+
+    for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev)
+      if(pg->ref == 0 && !pg->dirty)
+        break;
+    if(pg != &pcache.head){
+      unhash(pg);
+      break;
+    }
+
+    // every page is dirty or in use: write one that isn't in
+    // use, or else grow even though memory is short.
+    for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev)
+      if(pg->ref == 0)
+        break;
+    if(pg == &pcache.head){
+      if(mem || pcache.free == 0)
+        panic("pget: no pages");
+      release(&pcache.lock);
+      mem = kalloc();
+      acquire(&pcache.lock);
+      if(mem == 0)
+        panic("pget: no pages");
+      continue;
+    }
+    pg->ref++;
+    release(&pcache.lock);
+    acquiresleep(&pg->lock);
+    if(pg->dirty)
+      pgwrite(pg);
+    releasesleep(&pg->lock);
+    acquire(&pcache.lock);
+    pg->ref--;
+  }
+
+  pg->dev = dev;
+  pg->inum = inum;
+  pg->pgno = pgno;
+  pg->hnext = pcache.hash[phash(dev, inum, pgno)];
+  pcache.hash[phash(dev, inum, pgno)] = pg;
+  pg->valid = 0;
+  pg->dirty = 0;
+  pg->fresh = 0;
+  pg->ref = 1;
+  pcache.misses++;
+  release(&pcache.lock);
+  if(mem)
+    kfree(mem);
+  acquiresleep(&pg->lock);
+  return pg;
+}
+
+// Release a locked page, as the most recently used.
+static void
+prelse(struct page *pg)
+{
+  releasesleep(&pg->lock);
+
+  acquire(&pcache.lock);
+  pg->ref--;
+  if(pg->ref == 0){
+    lruremove(pg);
+    lrufront(pg);
+  }
+  release(&pcache.lock);
+}
+
+// Note which blocks hold the part of locked page pg that
+// lies inside regular file ip, locked.
+static void
+pmapblocks(struct inode *ip, struct page *pg)
+{
+  uint bn = pg->pgno * BPP;
+
+  for(int i = 0; i < BPP; i++, bn++)
+    pg->blockno[i] = bn * BSIZE < ip->size ? bmap(ip, bn) : 0;
+}
+
+// Fill locked page pg from regular file ip, locked.
+static void
+pfill(struct inode *ip, struct page *pg)
+{
+  memset(pg->data, 0, PGSIZE);
+  pmapblocks(ip, pg);
+  bpagerw(ip->dev, pg->blockno, (uchar*)pg->data, 0);
+  pg->valid = 1;
+}
+
+// readi() for regular files, with off and n checked.
+int
+preadi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  struct page *pg;
+  uint tot, m;
+
+  for(tot = 0; tot < n; tot += m, off += m, dst += m){
+    pg = pget(ip->dev, ip->inum, off / PGSIZE);
+    if(!pg->valid)
+      pfill(ip, pg);
+    m = min(n - tot, PGSIZE - off % PGSIZE);
+    if(either_copyout(user_dst, dst, pg->data + off % PGSIZE, m) == -1){
+      prelse(pg);
+      break;
+    }
+    prelse(pg);
+  }
+  return tot;
+}
+
+// Locked page pg of file ip, locked, is about to be written,
+// but processes are running it as program text, which must
+// not change under them. Leave it to them, belonging to no
+// file, and return a locked copy that takes its place.
+static struct page*
+ptextcopy(struct inode *ip, struct page *pg)
+{
+  struct page *npg;
+
+  acquire(&pcache.lock);
+  unhash(pg);
+  pcache.ntextcopy++;
+  release(&pcache.lock);
+
+  npg = pget(ip->dev, ip->inum, pg->pgno);
+  if(pg->valid)
+    memmove(npg->data, pg->data, PGSIZE);
+  npg->valid = pg->valid;
+  npg->dirty = pg->dirty;
+  npg->dirtytick = pg->dirtytick;
+  npg->fresh = pg->fresh;
+  memmove(npg->blockno, pg->blockno, sizeof(pg->blockno));
+  pg->dirty = 0;
+  pg->fresh = 0;
+  prelse(pg);
+  return npg;
+}
+
+// writei() for regular files, with off and n checked, in a
+// transaction, which allocates any new blocks. The data
+// itself waits in the page cache for the flusher.
+int
+pwritei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  struct page *pg;
+  uint tot, m, bn;
+
+  for(tot = 0; tot < n; tot += m, off += m, src += m){
+    pg = pget(ip->dev, ip->inum, off / PGSIZE);
+    if(pg->tmap > 0)
+      pg = ptextcopy(ip, pg);
+    m = min(n - tot, PGSIZE - off % PGSIZE);
+    if(!pg->valid){
+      // no need to read what will be overwritten or lies
+      // past the end of the file.
+      if(m == PGSIZE || off - off % PGSIZE >= ip->size){
+        memset(pg->data, 0, PGSIZE);
+        pmapblocks(ip, pg);
+        pg->valid = 1;
+      } else {
+        pfill(ip, pg);
+      }
+    }
+    for(bn = off / BSIZE; bn <= (off + m - 1) / BSIZE; bn++){
+      if(pg->blockno[bn % BPP] == 0)
+        pg->fresh = 1;  // a block past the old end: new
+      pg->blockno[bn % BPP] = bmap(ip, bn);
+    }
+    if(either_copyin(pg->data + off % PGSIZE, user_src, src, m) == -1){
+      prelse(pg);
+      break;
+    }
+    if(!pg->dirty){
+      pg->dirty = 1;
+      pg->dirtytick = ticks;
+    }
+    prelse(pg);
+  }
+  return tot;
+}
+
+// Drop the cached pages of inode ip, locked, whose blocks are
+// about to be freed. Dirty data is discarded. A page still
+// mapped somewhere stays until unmapped, but belongs to no
+// file, so it is never written.
+void
+pinval(struct inode *ip)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(;;){
+    for(pg = pcache.head.next; pg != &pcache.head; pg = pg->next)
+      if(pg->inum == ip->inum && pg->dev == ip->dev)
+        break;
+    if(pg == &pcache.head)
+      break;
+
+    // wait for the flusher, which may be writing it.
+    pg->ref++;
+    release(&pcache.lock);
+    acquiresleep(&pg->lock);
+    acquire(&pcache.lock);
+    unhash(pg);
+    pg->valid = 0;
+    pg->dirty = 0;
+    pg->fresh = 0;
+    memset(pg->blockno, 0, sizeof(pg->blockno));
+    release(&pcache.lock);
+    prelse(pg);
+    acquire(&pcache.lock);
+  }
+  release(&pcache.lock);
+}
+
+// The page pgno of regular file ip, locked, for a shared
+// mapping. Returns its physical address, with a reference
+// held until punmap(), or 0 if the page is past the largest
+// file size.
+uint64
+pmap(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+
+  if(pgno >= (MAXFILE * BSIZE + PGSIZE - 1) / PGSIZE)
+    return 0;
+  pg = pget(ip->dev, ip->inum, pgno);
+  if(!pg->valid)
+    pfill(ip, pg);
+  releasesleep(&pg->lock);
+  return (uint64)pg->data;
+}
+
+// Caller must hold pcache.lock.
+static struct page*
+pafind(uint64 pa)
+{
+  struct page *pg = bypa[PA2IDX(pa)];
+
+  if(pg == 0 || pg->data != (char*)pa)
+    panic("pafind");
+  return pg;
+}
+
+// Another mapping of the page at pa, by fork().
+void
+pmapdup(uint64 pa, int writable)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  pg = pafind(pa);
+  pg->ref++;
+  if(writable)
+    pg->wmap++;
+  release(&pcache.lock);
+}
+
+// A mapping of the page at pa is about to become writable.
+void
+pwritable(uint64 pa)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  pg = pafind(pa);
+  pg->wmap++;
+  pg->dirty = 1;
+  pg->dirtytick = ticks;
+  release(&pcache.lock);
+}
+
+// A mapping of the page at pa is gone. If it was writable,
+// the page is dirty, for the flusher to write.
+void
+punmap(uint64 pa, int writable)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  pg = pafind(pa);
+  if(writable){
+    pg->wmap--;
+    pg->dirty = 1;
+    pg->dirtytick = ticks;
+  }
+  pg->ref--;
+  if(pg->ref == 0){
+    lruremove(pg);
+    lrufront(pg);
+  }
+  release(&pcache.lock);
+}
+
+// The page pgno of regular file ip, locked, for exec() to map
+// as program text. Returns its physical address, with a
+// reference held until ptextunmap(), or 0.
+uint64
+ptextmap(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+  uint64 pa;
+
+  if((pa = pmap(ip, pgno)) == 0)
+    return 0;
+  acquire(&pcache.lock);
+  pg = pafind(pa);
+  pg->tmap++;
+  release(&pcache.lock);
+  return pa;
+}
+
+// Another text mapping of the page at pa, by fork().
+void
+ptextdup(uint64 pa)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  pg = pafind(pa);
+  pg->ref++;
+  pg->tmap++;
+  release(&pcache.lock);
+}
+
+// A text mapping of the page at pa is gone.
+void
+ptextunmap(uint64 pa)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  pg = pafind(pa);
+  pg->tmap--;
+  release(&pcache.lock);
+  punmap(pa, 0);
+}
+
+// Sort pages by their first block.
+static void
+sortpages(struct page **p, int n)
+{
+  int i, j;
+  struct page *t;
+
+  for(i = 1; i < n; i++){
+    t = p[i];
+    for(j = i; j > 0 && p[j-1]->blockno[0] > t->blockno[0]; j--)
+      p[j] = p[j-1];
+    p[j] = t;
+  }
+}
+
+// Write dirty pages to disk, in block order: those that have
+// been dirty for FLUSHAGE ticks, or all if all is set.
+void
+pflush(int all)
+{
+  struct page *pg, *batch[NFLUSH];
+  int i, n;
+  uint seq;
+
+  acquire(&pcache.lock);
+  seq = ++pcache.fseq;
+  release(&pcache.lock);
+
+  // a page mapped writable stays dirty when written, so take
+  // each page at most once.
+  do {
+    n = 0;
+    acquire(&pcache.lock);
+    for(pg = pcache.head.prev; pg != &pcache.head && n < NFLUSH; pg = pg->prev){
+      if(pg->dirty && pg->fseq != seq && (all || ticks - pg->dirtytick >= FLUSHAGE)){
+        pg->ref++;
+        pg->fseq = seq;
+        batch[n++] = pg;
+      }
+    }
+    release(&pcache.lock);
+
+    sortpages(batch, n);
+    for(i = 0; i < n; i++){
+      acquiresleep(&batch[i]->lock);
+      // someone may have written it meanwhile.
+      if(batch[i]->dirty)
+        pgwrite(batch[i]);
+      prelse(batch[i]);
+    }
+  } while(n == NFLUSH);
+}
+
+// Write the pages that have been given newly allocated blocks,
+// before commit() writes the log header that makes their
+// inodes point at those blocks. No FS system call is active,
+// so no page is being written to meanwhile.
+void
+pflushnew(void)
+{
+  struct page *pg, *batch[NFLUSH];
+  int i, n;
+
+  do {
+    n = 0;
+    acquire(&pcache.lock);
+    for(pg = pcache.head.next; pg != &pcache.head && n < NFLUSH; pg = pg->next){
+      if(pg->fresh){
+        pg->fresh = 0;
+        pg->ref++;
+        batch[n++] = pg;
+      }
+    }
+    release(&pcache.lock);
+
+    sortpages(batch, n);
+    for(i = 0; i < n; i++){
+      acquiresleep(&batch[i]->lock);
+      if(batch[i]->dirty && batch[i]->inum != 0)
+        pgwrite(batch[i]);
+      prelse(batch[i]);
+    }
+  } while(n == NFLUSH);
+}
+
+// Free up to npages clean pages that no one is using, least
+// recently used first. Called by kalloc() when memory runs
+// short. Returns the number of pages freed.
+int
+pshrink(int npages)
+{
+  struct page *pg, *prev;
+  int n = 0;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.prev; pg != &pcache.head && n < npages; pg = prev){
+    prev = pg->prev;
+    if(pg->ref != 0 || pg->dirty)
+      continue;
+    unhash(pg);
+    lruremove(pg);
+    bypa[PA2IDX(pg->data)] = 0;
+    kfree(pg->data);
+    pg->data = 0;
+    pg->next = pcache.free;
+    pcache.free = pg;
+    pcache.npage--;
+    n++;
+  }
+  release(&pcache.lock);
+  return n;
+}
+
+// Format the cache's size and hit rate into buf, for the
+// statistics device.
+int
+pstats(char *buf, int sz)
+{
+  uint hits, misses, npage, ndirty, nmapped, ntext, ntextcopy;
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  npage = pcache.npage;
+  hits = pcache.hits;
+  misses = pcache.misses;
+  ntextcopy = pcache.ntextcopy;
+  ndirty = nmapped = ntext = 0;
+  for(pg = pcache.head.next; pg != &pcache.head; pg = pg->next){
+    if(pg->dirty)
+      ndirty++;
+    if(pg->wmap > 0)
+      nmapped++;
+    if(pg->tmap > 0)
+      ntext++;
+  }
+  release(&pcache.lock);
+
+  return snprintf(buf, sz, "pcache: %d pages (max %d), %d dirty, %d mapped writable, %d text (%d replaced), %d hits, %d misses, %d%% hit rate\n",
+                  npage, NPAGE, ndirty, nmapped, ntext, ntextcopy, hits, misses,
+                  hits + misses == 0 ? 0 : (int)((uint64)hits * 100 / (hits + misses)));
+}
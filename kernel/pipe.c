@@ -3,22 +3,49 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "slab.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// A pipe's data is a ring of whole pages, PGSIZE bytes by
+// default; fcntl(F_SETPIPE_SZ) changes its size. The size is
+// always a power-of-two number of pages, so that it divides
+// 2^32 and nread and nwrite can simply wrap around.
+#define NPIPEPG (MAXPIPE / PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *pg[NPIPEPG]; // the ring's pages
+  uint size;      // bytes in the ring
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rbusy;      // pipeout() is reading the ring unlocked
+  int wbusy;      // pipein() is filling the ring unlocked
 };
 
+static struct slabcache pipecache;
+
+void
+pipeinit(void)
+{
+  slabinit(&pipecache, "pipe", sizeof(struct pipe));
+}
+
+// Where byte n of the stream goes in the ring. Sets *len to
+// how many bytes from there are contiguous in one page.
+static char*
+ringptr(struct pipe *pi, uint n, uint *len)
+{
+  uint off = n % pi->size;
+
+  *len = PGSIZE - off % PGSIZE;
+  return pi->pg[off / PGSIZE] + off % PGSIZE;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,12 +55,18 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = slaballoc(&pipecache)) == 0)
     goto bad;
+  memset(pi->pg, 0, sizeof(pi->pg));
+  if((pi->pg[0] = kalloc()) == 0)
+    goto bad;
+  pi->size = PGSIZE;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->rbusy = 0;
+  pi->wbusy = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -46,8 +79,11 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
-    kfree((char*)pi);
+  if(pi){
+    if(pi->pg[0])
+      kfree(pi->pg[0]);
+    slabfree(&pipecache, pi);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,21 +104,27 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    for(int i = 0; i < pi->size / PGSIZE; i++)
+      kfree(pi->pg[i]);
+    slabfree(&pipecache, pi);
   } else
     release(&pi->lock);
 }
 
+// Copy as much as fits, a page-contiguous chunk at a time,
+// and sleep only when the ring is full. addr is a user
+// virtual address if user_src is set, else a kernel address.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user_src, uint64 addr, int n)
 {
-  int i;
-  char ch;
+  int i, r;
+  uint m, len;
+  char *p;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(pi->wbusy || pi->nwrite == pi->nread + pi->size){  //DOC: pipewrite-full
       if(pi->readopen == 0 || pr->killed){
         release(&pi->lock);
         return -1;
@@ -90,38 +132,249 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-      break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    p = ringptr(pi, pi->nwrite, &len);
+    m = pi->nread + pi->size - pi->nwrite;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    if(either_copyin(p, user_src, addr + i, m) == -1){
+      // perhaps mmap()ed pages not read in yet, which can't
+      // happen under the pipe's lock: fault them in and retry.
+      if(!user_src)
+        break;
+      release(&pi->lock);
+      r = vmaprefault(addr + i, m, 0);
+      acquire(&pi->lock);
+      if(r < 0)
+        break;
+      m = 0;
+      continue;
+    }
+    pi->nwrite += m;
   }
   wakeup(&pi->nread);
   release(&pi->lock);
   return i;
 }
 
+// addr is a user virtual address if user_dst is set,
+// else a kernel address.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int user_dst, uint64 addr, int n)
 {
-  int i;
+  int i, r;
+  uint m, len;
+  char *p;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+again:
+  while(pi->rbusy || (pi->nread == pi->nwrite && pi->writeopen)){  //DOC: pipe-empty
     if(pr->killed){
       release(&pi->lock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    p = ringptr(pi, pi->nread, &len);
+    m = pi->nwrite - pi->nread;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    if(either_copyout(user_dst, addr + i, p, m) == -1){
+      // as in pipewrite(), but another reader may have had
+      // the pipe meanwhile: start over, unless there's
+      // already something to return.
+      if(!user_dst)
+        break;
+      release(&pi->lock);
+      r = vmaprefault(addr + i, m, 1);
+      acquire(&pi->lock);
+      if(r < 0 || i > 0)
+        break;
+      goto again;
+    }
+    pi->nread += m;
+  }
+  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  release(&pi->lock);
+  return i;
+}
+
+// Change the ring to hold at least size bytes, rounded up to
+// a power-of-two number of pages, at most MAXPIPE. Fails if
+// the data already in the pipe wouldn't fit. Returns the
+// new size.
+int
+pipesetsize(struct pipe *pi, int size)
+{
+  char *pg[NPIPEPG], *old[NPIPEPG];
+  int npg, nold, i;
+  uint n, m, len, off;
+  char *p;
+
+  if(size <= 0 || size > MAXPIPE)
+    return -1;
+  for(npg = 1; npg * PGSIZE < size; npg *= 2)
+    ;
+
+  // allocate first: kalloc() can reclaim buffer cache
+  // memory, which shouldn't happen under a spinlock.
+  for(i = 0; i < npg; i++){
+    if((pg[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(pg[i]);
+      return -1;
+    }
+  }
+
+  acquire(&pi->lock);
+  while(pi->rbusy || pi->wbusy)
+    sleep(&pi->nwrite, &pi->lock);
+  n = pi->nwrite - pi->nread;
+  if(n > npg * PGSIZE){
+    release(&pi->lock);
+    for(i = 0; i < npg; i++)
+      kfree(pg[i]);
+    return -1;
+  }
+
+  // move the data to the start of the new ring.
+  for(off = 0; off < n; off += m){
+    p = ringptr(pi, pi->nread + off, &len);
+    m = n - off;
+    if(m > len)
+      m = len;
+    if(m > PGSIZE - off % PGSIZE)
+      m = PGSIZE - off % PGSIZE;
+    memmove(pg[off / PGSIZE] + off % PGSIZE, p, m);
+  }
+
+  nold = pi->size / PGSIZE;
+  for(i = 0; i < nold; i++)
+    old[i] = pi->pg[i];
+  for(i = 0; i < NPIPEPG; i++)
+    pi->pg[i] = i < npg ? pg[i] : 0;
+  pi->size = npg * PGSIZE;
+  pi->nread = 0;
+  pi->nwrite = n;
+  wakeup(&pi->nwrite);  // maybe more room
+  release(&pi->lock);
+
+  for(i = 0; i < nold; i++)
+    kfree(old[i]);
+  return npg * PGSIZE;
+}
+
+int
+pipegetsize(struct pipe *pi)
+{
+  return pi->size;
+}
+
+// Move up to n bytes from file f into the pipe, reading them
+// straight into the ring's pages. Waits for room, but once
+// something has been moved, returns rather than wait for
+// more.
+int
+pipein(struct pipe *pi, struct file *f, int n)
+{
+  int i, r;
+  uint m, len;
+  char *p;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pi->wbusy || pi->nwrite == pi->nread + pi->size){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    wakeup(&pi->nread);
+    sleep(&pi->nwrite, &pi->lock);
+  }
+
+  // other writers wait while wbusy is set, so the free part
+  // of the ring stays ours with the lock released.
+  pi->wbusy = 1;
+  for(i = 0; i < n && pi->nwrite != pi->nread + pi->size; i += r){
+    p = ringptr(pi, pi->nwrite, &len);
+    m = pi->nread + pi->size - pi->nwrite;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    release(&pi->lock);
+    r = fileread(f, 0, (uint64)p, m);
+    acquire(&pi->lock);
+    if(r <= 0){
+      if(i == 0)
+        i = r;
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    }
+    pi->nwrite += r;
+    if(r < m)
       break;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pi->wbusy = 0;
+  wakeup(&pi->nread);
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+  return i;
+}
+
+// Move up to n bytes from the pipe into file f, writing
+// them straight from the ring's pages. With tee set, leaves
+// them in the pipe. Waits for data, but once something has
+// been moved, returns rather than wait for more.
+int
+pipeout(struct pipe *pi, struct file *f, int n, int tee)
+{
+  int i, r;
+  uint m, len, nread;
+  char *p;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pi->rbusy || (pi->nread == pi->nwrite && pi->writeopen)){
+    if(pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    sleep(&pi->nread, &pi->lock);
+  }
+
+  // other readers wait while rbusy is set, so the data in the
+  // ring stays put with the lock released.
+  pi->rbusy = 1;
+  nread = pi->nread;
+  for(i = 0; i < n && nread != pi->nwrite; i += r){
+    p = ringptr(pi, nread, &len);
+    m = pi->nwrite - nread;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    release(&pi->lock);
+    r = filewrite(f, 0, (uint64)p, m);
+    acquire(&pi->lock);
+    if(r <= 0){
+      if(i == 0)
+        i = r;
+      break;
+    }
+    nread += r;
+    if(!tee)
+      pi->nread = nread;
+    if(r < m)
+      break;
+  }
+  pi->rbusy = 0;
+  wakeup(&pi->nread);
+  wakeup(&pi->nwrite);
   release(&pi->lock);
   return i;
 }
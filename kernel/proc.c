@@ -16,6 +16,7 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
 
@@ -40,10 +41,27 @@ procinit(void)
       uint64 va = KSTACK((int) (p - proc));
       kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
       p->kstack = va;
+      p->kstackpa = (uint64)pa;
   }
   kvminithart();
 }
 
+// Return the physical address of va, if it lies in a
+// process's kernel stack, or 0 if not. Uses the address
+// procinit() recorded rather than walking the page table.
+uint64
+kstackpa(uint64 va)
+{
+  uint64 d;
+
+  if(va >= TRAMPOLINE)
+    return 0;
+  d = TRAMPOLINE - PGROUNDDOWN(va);
+  if(d % (2*PGSIZE) != 0 || d / (2*PGSIZE) > NPROC)
+    return 0;  // not a stack page
+  return proc[d / (2*PGSIZE) - 1].kstackpa + va % PGSIZE;
+}
+
 // Must be called with interrupts disabled,
 // to prevent race with process being moved
 // to a different CPU.
@@ -106,6 +124,7 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  p->state = USED;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -140,15 +159,17 @@ freeproc(struct proc *p)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
   if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+    proc_freepagetable(p->pagetable, p->sz, p->seg);
   p->pagetable = 0;
   p->sz = 0;
+  memset(p->seg, 0, sizeof(p->seg));
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->vfork = 0;
   p->state = UNUSED;
 }
 
@@ -170,15 +191,15 @@ proc_pagetable(struct proc *p)
   // to/from user space, so not PTE_U.
   if(mappages(pagetable, TRAMPOLINE, PGSIZE,
               (uint64)trampoline, PTE_R | PTE_X) < 0){
-    uvmfree(pagetable, 0);
+    uvmfree(pagetable, 0, 0);
     return 0;
   }
 
   // map the trapframe just below TRAMPOLINE, for trampoline.S.
   if(mappages(pagetable, TRAPFRAME, PGSIZE,
               (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
-    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-    uvmfree(pagetable, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0, 0);
+    uvmfree(pagetable, 0, 0);
     return 0;
   }
 
@@ -186,13 +207,14 @@ proc_pagetable(struct proc *p)
 }
 
 // Free a process's page table, and free the
-// physical memory it refers to.
+// physical memory it refers to. seg has the parts of
+// its program not yet paged in, or is 0.
 void
-proc_freepagetable(pagetable_t pagetable, uint64 sz)
+proc_freepagetable(pagetable_t pagetable, uint64 sz, struct seg *seg)
 {
-  uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
-  uvmfree(pagetable, sz);
+  uvmunmap(pagetable, TRAMPOLINE, 1, 0, 0);
+  uvmunmap(pagetable, TRAPFRAME, 1, 0, 0);
+  uvmfree(pagetable, sz, seg);
 }
 
 // a user program that calls exec("/init")
@@ -241,13 +263,19 @@ growproc(int n)
   uint sz;
   struct proc *p = myproc();
 
+  if(p->vfork)
+    return -1;  // the memory is the parent's
   sz = p->sz;
   if(n > 0){
+    if((uint64)sz + n > vmabase(p))
+      return -1;  // would run into an mmap()ed region
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
       return -1;
     }
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if(uvmdealloc(p->pagetable, sz, sz + n, p->seg) != sz + n)
+      return -1;  // no memory to split a megapage
+    sz += n;
   }
   p->sz = sz;
   return 0;
@@ -261,20 +289,31 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *p = myproc();
+  struct inode *exe;
 
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
   }
+  // copying may sleep to swap pages in or out, so it's done
+  // without the child's lock, as in spawn().
+  release(&np->lock);
+
+  // the child pages in what the parent hasn't yet, from the
+  // same program. set up first, so that freeproc() knows what
+  // was never mapped if the rest fails.
+  if(p->exe)
+    np->exe = execdup(p->exe);
+  memmove(np->seg, p->seg, sizeof(p->seg));
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
-    freeproc(np);
-    release(&np->lock);
-    return -1;
-  }
+  if(uvmcopy(p->pagetable, np->pagetable, p->sz, p->seg) < 0)
+    goto bad;
   np->sz = p->sz;
 
+  if(vmafork(np, p) < 0)
+    goto bad;
+
   np->parent = p;
 
   // copy saved user registers.
@@ -293,8 +332,133 @@ fork(void)
 
   pid = np->pid;
 
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  return pid;
+
+ bad:
+  exe = np->exe;
+  np->exe = 0;
+  acquire(&np->lock);
+  freeproc(np);
+  release(&np->lock);
+  execput(exe);
+  return -1;
+}
+
+// Create a child that runs in this process's memory, even
+// its trapframe page, rather than a copy, and wait until the
+// child calls exec() or exit(), which is all it should do:
+// it can't grow its memory or mmap() meanwhile.
+int
+vfork(void)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct trapframe tf;
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  proc_freepagetable(np->pagetable, 0, 0);
+  kfree((void*)np->trapframe);
+  np->pagetable = p->pagetable;
+  np->trapframe = p->trapframe;
+  np->sz = p->sz;
+  np->vfork = 1;
+
+  np->parent = p;
+
+  // the child returns 0 through the trapframe they share;
+  // this process's registers are put back once it's done.
+  tf = *p->trapframe;
+  np->trapframe->a0 = 0;
+
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+  if(p->exe)
+    np->exe = execdup(p->exe);
+  memmove(np->seg, p->seg, sizeof(p->seg));
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
   np->state = RUNNABLE;
 
+  // not even a kill() ends the wait, since the child is using
+  // this process's memory.
+  while(np->vfork)
+    sleep(np, &np->lock);
+  release(&np->lock);
+
+  *p->trapframe = tf;
+  return pid;
+}
+
+// vfork()ed child p is done with its parent's memory.
+void
+vforkdone(struct proc *p)
+{
+  acquire(&p->lock);
+  p->vfork = 0;
+  release(&p->lock);
+  wakeup(p);
+}
+
+// Start a child running the program path, as fork() and then
+// exec() would, but loading the program straight into the
+// child rather than copying this process first. The child's
+// descriptors 0, 1 and 2 are the files f[0], f[1] and f[2],
+// or closed where those are 0; it has no others.
+int
+spawn(char *path, char **argv, struct file **f)
+{
+  int i, pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  // loading sleeps, so the child is built without its lock
+  // held; being USED, it won't be handed out again or run.
+  release(&np->lock);
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+
+  for(i = 0; i < 3; i++)
+    if(f[i])
+      np->ofile[i] = filedup(f[i]);
+  np->cwd = idup(p->cwd);
+
+  if((argc = execproc(np, path, argv)) < 0){
+    for(i = 0; i < 3; i++){
+      if(np->ofile[i]){
+        fileclose(np->ofile[i]);
+        np->ofile[i] = 0;
+      }
+    }
+    begin_op();
+    iput(np->cwd);
+    end_op();
+    np->cwd = 0;
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+  np->parent = p;
+
+  pid = np->pid;
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
   release(&np->lock);
 
   return pid;
@@ -337,6 +501,17 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // a vfork()ed child gives its parent back its memory.
+  if(p->vfork){
+    p->pagetable = 0;
+    p->trapframe = 0;
+    p->sz = 0;
+    vforkdone(p);
+  }
+
+  // Write back and drop mmap()ed regions.
+  vmaexit(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -350,6 +525,8 @@ exit(int status)
   iput(p->cwd);
   end_op();
   p->cwd = 0;
+  execput(p->exe);
+  p->exe = 0;
 
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
@@ -401,11 +578,17 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
-  // hold p->lock for the whole time to avoid lost
-  // wakeups from a child's exit().
-  acquire(&p->lock);
-
   for(;;){
+    // copyout() can't swap the status back in while we hold
+    // the locks, so fault it in first. It may have been
+    // swapped out again while we slept, hence each time round.
+    if(addr != 0 && vmaprefault(addr, sizeof(int), 1) < 0)
+      return -1;
+
+    // hold p->lock for the whole scan to avoid lost
+    // wakeups from a child's exit().
+    acquire(&p->lock);
+
     // Scan through table looking for exited children.
     havekids = 0;
     for(np = proc; np < &proc[NPROC]; np++){
@@ -441,8 +624,10 @@ wait(uint64 addr)
       return -1;
     }
     
-    // Wait for a child to exit.
+    // Wait for a child to exit. A child that exits once we
+    // let go of p->lock is still a zombie when we look again.
     sleep(p, &p->lock);  //DOC: wait-sleep
+    release(&p->lock);
   }
 }
 
@@ -484,8 +669,11 @@ scheduler(void)
       release(&p->lock);
     }
     if(found == 0) {
+      // nothing to run: zero a page for kalloc_zero(), or if
+      // there's no need, wait for an interrupt.
       intr_on();
-      asm volatile("wfi");
+      if(!kzeroidle())
+        asm volatile("wfi");
     }
   }
 }
@@ -549,6 +737,34 @@ forkret(void)
   usertrapret();
 }
 
+// Start a kernel thread running fn(), which must not return.
+// It has a process slot, so it can sleep, but never
+// enters user space.
+void
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+// A kernel thread's first scheduling will swtch here.
+static void
+kthreadret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  myproc()->kfn();
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -673,6 +889,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
@@ -80,7 +80,28 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+// A file mapped into a process's address space with mmap().
+// Pages are read in from the file when first touched.
+struct vma {
+  uint64 addr;     // page-aligned start; 0 if the slot is free
+  uint64 len;      // bytes, a multiple of PGSIZE
+  int prot;        // PROT_*
+  int flags;       // MAP_SHARED or MAP_PRIVATE
+  struct file *f;
+  uint off;        // file offset of addr
+};
+
+// Part of the program a process runs that exec() left to be
+// filled in a page at a time, as it is first touched: text
+// mapped from the page cache, or zeroed bss.
+struct seg {
+  uint64 va;       // page-aligned start
+  uint64 len;      // bytes; 0 if the slot is free
+  uint off;        // file offset of va, for text
+  int perm;        // PTE_*; PTE_TEXT if from the program file
+};
+
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
@@ -93,14 +114,22 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int vfork;                   // Borrowing parent's memory until exec() or exit()
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
+  uint64 kstackpa;             // Physical address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct vma vma[NVMA];        // mmap()ed regions
+  struct inode *exe;           // Program file being run
+  struct seg seg[NSEG];        // Parts of it not yet paged in
+  int nilock;                  // Inode locks held (see vmafault)
+  int ucopy;                   // Copying user memory by its physical address (see swap.c)
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Kernel thread body, if any
 };
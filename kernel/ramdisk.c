@@ -1,5 +1,8 @@
 //
-// ramdisk that uses the disk image loaded by qemu -initrd fs.img
+// RAM disk, for kernels built with make RAMDISK=1.
+// fsimg.S links a copy of fs.img into the kernel's data,
+// and reads and writes are memory copies to and from it.
+// Changes last until the machine is reset.
 //
 
 #include "types.h"
@@ -12,34 +15,30 @@
 #include "fs.h"
 #include "buf.h"
 
+extern char ramdisk[], eramdisk[];  // fsimg.S
+
 void
 ramdiskinit(void)
 {
+  if(eramdisk - ramdisk < FSSIZE*BSIZE)
+    panic("ramdiskinit: image too small");
 }
 
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
+// Read or write the n locked bufs in b[].
 void
-ramdiskrw(struct buf *b)
+ramdiskrw(struct buf **b, int n, int write)
 {
-  if(!holdingsleep(&b->lock))
-    panic("ramdiskrw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("ramdiskrw: nothing to do");
-
-  if(b->blockno >= FSSIZE)
-    panic("ramdiskrw: blockno too big");
+  for(int i = 0; i < n; i++){
+    if(!holdingsleep(&b[i]->lock))
+      panic("ramdiskrw: buf not locked");
+    if(b[i]->blockno >= (eramdisk - ramdisk) / BSIZE)
+      panic("ramdiskrw: blockno too big");
 
-  uint64 diskaddr = b->blockno * BSIZE;
-  char *addr = (char *)RAMDISK + diskaddr;
+    char *addr = ramdisk + (uint64)b[i]->blockno * BSIZE;
 
-  if(b->flags & B_DIRTY){
-    // write
-    memmove(addr, b->data, BSIZE);
-    b->flags &= ~B_DIRTY;
-  } else {
-    // read
-    memmove(b->data, addr, BSIZE);
-    b->flags |= B_VALID;
+    if(write)
+      memmove(addr, b[i]->data, BSIZE);
+    else
+      memmove(b[i]->data, addr, BSIZE);
   }
 }
@@ -331,6 +331,9 @@ sfence_vma()
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_A (1L << 6) // accessed, set by the hardware
+#define PTE_TEXT (1L << 8) // software: program text shared from the page cache
+#define PTE_SWAP (1L << 9) // software: not valid, page is in swap slot PTE2SLOT
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -339,11 +342,28 @@ sfence_vma()
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// a swapped-out page's slot goes where its address was.
+#define SLOT2PTE(slot) (((uint64)(slot)) << 10)
+#define PTE2SLOT(pte) ((uint)((pte) >> 10))
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
 #define PX(level, va) ((((uint64) (va)) >> PXSHIFT(level)) & PXMASK)
 
+// bytes mapped by a leaf PTE at level: 4KB, 2MB (a megapage)
+// or 1GB (a gigapage).
+#define LEVELSIZE(level) (1L << PXSHIFT(level))
+
+// a megapage, the size of a user huge page.
+#define HUGEPGSIZE LEVELSIZE(1)
+#define HUGEPGROUNDUP(sz)  (((sz)+HUGEPGSIZE-1) & ~(HUGEPGSIZE-1))
+#define HUGEPGROUNDDOWN(a) (((a)) & ~(HUGEPGSIZE-1))
+
+// a valid PTE with any of R, W, X set is a leaf; otherwise it
+// points to the next level of the page table.
+#define PTE_LEAF(pte) ((pte) & (PTE_R|PTE_W|PTE_X))
+
 // one beyond the highest possible virtual address.
 // MAXVA is actually one bit less than the max allowed by
 // Sv39, to avoid having to sign-extend virtual addresses
@@ -0,0 +1,217 @@
+//
+// Slab allocator for kernel objects: struct file, struct
+// inode, struct buf and struct pipe.
+//
+// A slab is one page from kalloc(), holding a header and
+// then as many objects of its cache's size as fit. The free
+// objects of a slab are linked through their first words.
+// A slab whose objects are all free goes back to kalloc().
+//
+// Each CPU also keeps a magazine of up to MAGSIZE free
+// objects per cache, which it uses with interrupts off and
+// without taking the cache's lock. An empty magazine is
+// refilled with half a magazine from the slabs, and a full
+// one gives half of its objects back.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slabcache *cache;
+  struct slab *next;  // on the cache's partial list
+  struct slab *prev;
+  void *free;         // free objects
+  int nfree;          // how many
+};
+
+// objects start after the header, 16-byte aligned.
+#define SLABHDR ((sizeof(struct slab) + 15) & ~15)
+
+static struct slabcache *caches;  // all caches, created at boot
+
+void
+slabinit(struct slabcache *c, char *name, uint size)
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  if(c->perslab == 0)
+    panic("slabinit");
+  c->partial = 0;
+  c->next = caches;
+  caches = c;
+}
+
+static void
+partialadd(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+static void
+partialremove(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Carve page pg into a slab of free objects for c.
+// Caller holds c->lock.
+static void
+newslab(struct slabcache *c, char *pg)
+{
+  struct slab *s = (struct slab*)pg;
+  char *obj;
+  int i;
+
+  s->cache = c;
+  s->free = 0;
+  for(i = c->perslab - 1; i >= 0; i--){
+    obj = pg + SLABHDR + i*c->size;
+    *(void**)obj = s->free;
+    s->free = obj;
+  }
+  s->nfree = c->perslab;
+  c->nslab++;
+  c->nfree += c->perslab;
+  partialadd(c, s);
+}
+
+// Take a free object from c's slabs, of which there must be
+// one. Caller holds c->lock.
+static void*
+take(struct slabcache *c)
+{
+  struct slab *s = c->partial;
+  void *obj;
+
+  obj = s->free;
+  s->free = *(void**)obj;
+  c->nfree--;
+  if(--s->nfree == 0)
+    partialremove(c, s);
+  return obj;
+}
+
+// Give obj back to its slab, and the slab back to kalloc()
+// if that leaves it with no objects in use. Caller holds
+// c->lock.
+static void
+put(struct slabcache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->cache != c)
+    panic("slabfree");
+  if(s->nfree == 0)
+    partialadd(c, s);
+  *(void**)obj = s->free;
+  s->free = obj;
+  c->nfree++;
+  if(++s->nfree == c->perslab){
+    partialremove(c, s);
+    c->nslab--;
+    c->nfree -= c->perslab;
+    kfree((char*)s);
+  }
+}
+
+// Allocate an object from c. Returns 0 if out of memory.
+// The object's contents are garbage. Like kalloc(), must
+// not be called with bcache.lock or pcache.lock held.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *obj;
+  char *pg;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n > 0){
+    obj = m->obj[--m->n];
+    pop_off();
+    return obj;
+  }
+  pop_off();
+
+  acquire(&c->lock);
+  while(c->nfree == 0){
+    // kalloc() may shrink the buffer cache, which frees
+    // bufs to their cache, so don't hold the lock.
+    release(&c->lock);
+    if((pg = kalloc()) == 0)
+      return 0;
+    acquire(&c->lock);
+    newslab(c, pg);
+  }
+  obj = take(c);
+  // refill this CPU's magazine while here.
+  m = &c->mag[cpuid()];
+  while(m->n < MAGSIZE/2 && c->nfree > 0)
+    m->obj[m->n++] = take(c);
+  release(&c->lock);
+  return obj;
+}
+
+// Free an object that slaballoc(c) returned.
+void
+slabfree(struct slabcache *c, void *obj)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n < MAGSIZE){
+    m->obj[m->n++] = obj;
+    pop_off();
+    return;
+  }
+  pop_off();
+
+  // the magazine is full: give back half of it, and obj.
+  acquire(&c->lock);
+  m = &c->mag[cpuid()];
+  while(m->n > MAGSIZE/2)
+    put(c, m->obj[--m->n]);
+  put(c, obj);
+  release(&c->lock);
+}
+
+// Format each cache's objects in use, objects allocated,
+// and slabs into buf, for the statistics device.
+int
+slabstats(char *buf, int sz)
+{
+  struct slabcache *c;
+  int n, i, inmag, total;
+
+  n = snprintf(buf, sz, "slab:");
+  for(c = caches; c; c = c->next){
+    acquire(&c->lock);
+    inmag = 0;
+    for(i = 0; i < NCPU; i++)
+      inmag += c->mag[i].n;
+    total = c->nslab * c->perslab;
+    n += snprintf(buf + n, sz - n, " %s %d/%d in %d pages,", c->name,
+                  total - c->nfree - inmag, total, c->nslab);
+    release(&c->lock);
+  }
+  buf[n - 1] = '\n';
+  return n;
+}
@@ -0,0 +1,22 @@
+// Free objects a CPU keeps for itself, so that most
+// allocations and frees take no lock.
+#define MAGSIZE 16
+
+struct magazine {
+  int n;                // objects in obj[]
+  void *obj[MAGSIZE];
+};
+
+// A cache of kernel objects of one size, carved out of
+// pages ("slabs") from kalloc().
+struct slabcache {
+  struct spinlock lock; // protects everything but mag[]
+  char *name;
+  uint size;            // bytes per object
+  uint perslab;         // objects per slab
+  struct slab *partial; // slabs with free objects
+  int nslab;            // slabs allocated
+  int nfree;            // free objects in slabs
+  struct magazine mag[NCPU]; // each used by its CPU only
+  struct slabcache *next;    // all caches, for stats
+};
@@ -30,6 +30,23 @@ acquiresleep(struct sleeplock *lk)
   release(&lk->lk);
 }
 
+// Take lk if it is free, without waiting. Returns 1 if it
+// was taken, else 0.
+int
+tryacquiresleep(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = !lk->locked;
+  if(r){
+    lk->locked = 1;
+    lk->pid = myproc()->pid;
+  }
+  release(&lk->lk);
+  return r;
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
@@ -0,0 +1,106 @@
+//
+// formatted output to a string -- snprintf.
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+static char digits[] = "0123456789abcdef";
+
+static int
+sputc(char *s, char c)
+{
+  *s = c;
+  return 1;
+}
+
+static int
+sprintint(char *s, int xx, int base, int sign)
+{
+  char buf[16];
+  int i, n;
+  uint x;
+
+  if(sign && (sign = xx < 0))
+    x = -xx;
+  else
+    x = xx;
+
+  i = 0;
+  do {
+    buf[i++] = digits[x % base];
+  } while((x /= base) != 0);
+
+  if(sign)
+    buf[i++] = '-';
+
+  n = 0;
+  while(--i >= 0)
+    n += sputc(s+n, buf[i]);
+  return n;
+}
+
+// Print to buf, writing at most sz-1 characters and a
+// terminating nul. Only understands %d, %x, %s.
+// Returns the number of characters written, not
+// counting the nul.
+int
+snprintf(char *buf, int sz, char *fmt, ...)
+{
+  va_list ap;
+  int i, c;
+  int off = 0;
+  char *s;
+  char tmp[16];
+
+  if(fmt == 0)
+    panic("null fmt");
+  if(sz <= 0)
+    return 0;
+
+  va_start(ap, fmt);
+  for(i = 0; off < sz-1 && (c = fmt[i] & 0xff) != 0; i++){
+    if(c != '%'){
+      off += sputc(buf+off, c);
+      continue;
+    }
+    c = fmt[++i] & 0xff;
+    if(c == 0)
+      break;
+    switch(c){
+    case 'd':
+    case 'x':
+      s = tmp;
+      s[sprintint(tmp, va_arg(ap, int), c == 'd' ? 10 : 16, c == 'd')] = 0;
+      for(; *s && off < sz-1; s++)
+        off += sputc(buf+off, *s);
+      break;
+    case 's':
+      if((s = va_arg(ap, char*)) == 0)
+        s = "(null)";
+      for(; *s && off < sz-1; s++)
+        off += sputc(buf+off, *s);
+      break;
+    case '%':
+      off += sputc(buf+off, '%');
+      break;
+    default:
+      // Print unknown % sequence to draw attention.
+      off += sputc(buf+off, '%');
+      if(off < sz-1)
+        off += sputc(buf+off, c);
+      break;
+    }
+  }
+  va_end(ap);
+  buf[off] = 0;
+  return off;
+}
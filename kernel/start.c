@@ -38,6 +38,9 @@ start()
   w_mideleg(0xffff);
   w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
+  // let supervisor mode read the time CSR.
+  w_mcounteren(r_mcounteren() | 2);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -0,0 +1,97 @@
+//
+// The statistics device. Reading it returns a snapshot
+// of counters from around the kernel, as text, one
+// subsystem per line. Writing "diskmode intr", "diskmode
+// poll" or "diskmode hybrid" to it switches the disk
+// driver's completion mode, so that the modes' latencies
+// can be compared in one boot.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ PGSIZE
+
+// Each of these formats its counters into buf,
+// and returns the number of characters written.
+static int (*statsfns[])(char*, int) = {
+  bstats,
+  pstats,
+  logstats,
+  kmemstats,
+  slabstats,
+  kvmstats,
+  thpstats,
+  swapstats,
+#ifndef RAMDISK
+  ioschedstats,
+  virtio_disk_stats,
+#endif
+};
+
+static struct {
+  struct sleeplock lock;
+  char buf[BUFSZ];
+  int sz;   // size of the current snapshot
+  int off;  // how much of it has been read
+} stats;
+
+// A read from the start takes a fresh snapshot, which
+// successive reads return until it has been consumed.
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int i, m;
+
+  acquiresleep(&stats.lock);
+  if(stats.sz == 0){
+    for(i = 0; i < NELEM(statsfns); i++)
+      stats.sz += statsfns[i](stats.buf + stats.sz, BUFSZ - stats.sz);
+  }
+  m = stats.sz - stats.off;
+  if(m > n)
+    m = n;
+  if(m == 0){
+    // end of this snapshot; the next read takes another.
+    stats.sz = stats.off = 0;
+  } else if(either_copyout(user_dst, dst, stats.buf + stats.off, m) == -1){
+    m = -1;
+  } else {
+    stats.off += m;
+  }
+  releasesleep(&stats.lock);
+  return m;
+}
+
+// A write is a single command.
+int
+statswrite(int user_src, uint64 src, int n)
+{
+  char cmd[32];
+
+  if(n <= 0 || n >= sizeof(cmd) || either_copyin(cmd, user_src, src, n) == -1)
+    return -1;
+  cmd[n] = 0;
+  if(cmd[n-1] == '\n')
+    cmd[n-1] = 0;
+#ifndef RAMDISK
+  if(strncmp(cmd, "diskmode ", 9) == 0)
+    return virtio_disk_setmode(cmd + 9) < 0 ? -1 : n;
+#endif
+  return -1;
+}
+
+void
+statsinit(void)
+{
+  initsleeplock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
@@ -0,0 +1,286 @@
+//
+// Swapping. When memory runs out, ualloc() writes cold pages
+// of user processes to the swap area that mkfs leaves after
+// the file system, and frees them; the page fault in
+// usertrap(), or copyin()/copyout(), reads them back.
+//
+// Pages are picked by a clock algorithm over the processes'
+// page tables: a page whose accessed bit is set gets it
+// cleared instead, and is taken only if the hand comes round
+// again before it is used. Only the memory below p->sz of a
+// sleeping or runnable process is swapped, and not its
+// program text, which the page cache can read again, nor its
+// megapages.
+//
+// A swapped-out page's PTE is left invalid, with PTE_SWAP
+// set, its permission bits kept, and its slot in place of
+// the physical address.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NSLOT (NSWAP / BPP)
+#define SWAPBATCH 16  // pages written out each time memory runs out
+
+// slot states
+#define SLOTUSED 1  // holds a page
+#define SLOTBUSY 2  // the page is being written
+
+extern struct proc proc[NPROC];
+
+static struct {
+  struct spinlock lock;  // protects slot[] and nused
+  struct sleeplock hand; // one reclaimer at a time; protects p and va
+  uchar slot[NSLOT];
+  int nused;
+  int next;     // where slotalloc() looks first
+  int dev;
+  uint start;   // first swap block
+  int nslot;    // 0 if the disk has no swap area
+  int p;        // the clock hand: proc[p]
+  uint64 va;    // at this address
+  int nout;     // pages ever written out
+  int nin;      // pages ever read back
+  int nfull;    // times swap was full
+} swap;
+
+// Called by fsinit(), once the superblock has been read.
+void
+swapinit(int dev, struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.hand, "swaphand");
+  swap.dev = dev;
+  swap.start = sb->swapstart;
+  swap.nslot = sb->nswap / BPP;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+#ifdef RAMDISK
+  swap.nslot = 0;  // fsimg.S leaves the swap area out
+#endif
+}
+
+// The disk blocks of slot s.
+static void
+slotblocks(uint s, uint *blockno)
+{
+  int i;
+
+  for(i = 0; i < BPP; i++)
+    blockno[i] = swap.start + s*BPP + i;
+}
+
+// A free slot, marked busy for the page about to be written
+// to it, or -1.
+static int
+slotalloc(void)
+{
+  int i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.next + i) % swap.nslot;
+    if(swap.slot[s] == 0){
+      swap.slot[s] = SLOTUSED | SLOTBUSY;
+      swap.nused++;
+      swap.next = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  swap.nfull++;
+  release(&swap.lock);
+  return -1;
+}
+
+// The page has been written to slot s. Wake up whoever waits
+// to read it back, and free the slot if its page went away
+// meanwhile.
+static void
+slotdone(uint s)
+{
+  acquire(&swap.lock);
+  swap.slot[s] &= ~SLOTBUSY;
+  if(swap.slot[s] == 0)
+    swap.nused--;
+  wakeup(&swap.slot[s]);
+  release(&swap.lock);
+}
+
+// Free slot s, whose page is no longer wanted. Doesn't sleep,
+// so it can be called under a spinlock; if the slot is still
+// being written, slotdone() frees it.
+void
+swapfree(uint s)
+{
+  acquire(&swap.lock);
+  swap.slot[s] &= ~SLOTUSED;
+  if(swap.slot[s] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// May q's memory be swapped out? Not while q is running,
+// being built or torn down, nor if its page table is shared
+// with a vfork() child, nor while q is in copyin(), copyout()
+// or the like, which may have been preempted holding the
+// physical address of one of its pages. q->lock must be held.
+static int
+swappable(struct proc *q)
+{
+  struct proc *r;
+
+  if(q->state != SLEEPING && q->state != RUNNABLE)
+    return 0;
+  if(q->kfn || q->pagetable == 0 || q->vfork || q->ucopy)
+    return 0;
+  for(r = proc; r < &proc[NPROC]; r++)
+    if(r->vfork && r->pagetable == q->pagetable)
+      return 0;
+  return 1;
+}
+
+// Take the first cold page of q from the clock hand on, and
+// leave its PTE pointing at slot s. Returns the page's
+// physical address, or 0 once the hand has passed the end of
+// q's memory. q->lock must be held, so that q can't run and
+// use the PTEs meanwhile.
+static uint64
+steal(struct proc *q, int s)
+{
+  pte_t *pte;
+  uint64 pa;
+  int level;
+
+  for(; swap.va < q->sz; swap.va += PGSIZE){
+    if((pte = walkleaf(q->pagetable, swap.va, &level)) == 0)
+      continue;
+    if(level > 0){
+      swap.va = HUGEPGROUNDDOWN(swap.va) + HUGEPGSIZE - PGSIZE;
+      continue;
+    }
+    // not text, and not the stack guard page.
+    if((*pte & PTE_TEXT) || (*pte & PTE_U) == 0)
+      continue;
+    if(*pte & PTE_A){
+      // q has used it since the hand last came by; q's TLB
+      // entries are flushed when it next runs.
+      *pte &= ~PTE_A;
+      continue;
+    }
+    pa = PTE2PA(*pte);
+    *pte = SLOT2PTE(s) | (*pte & (PTE_R|PTE_W|PTE_X|PTE_U)) | PTE_SWAP;
+    swap.va += PGSIZE;
+    return pa;
+  }
+  return 0;
+}
+
+// Write out and free up to n pages, moving the clock hand at
+// most twice round all the processes. Returns how many were
+// freed.
+static int
+swapout(int n)
+{
+  struct proc *q;
+  uint blockno[BPP];
+  uint64 pa;
+  int s, freed, passes;
+
+  freed = 0;
+  s = -1;
+  acquiresleep(&swap.hand);
+  for(passes = 0; freed < n && passes < 2*NPROC; ){
+    if(s < 0 && (s = slotalloc()) < 0)
+      break;
+    q = &proc[swap.p];
+    acquire(&q->lock);
+    pa = swappable(q) ? steal(q, s) : 0;
+    release(&q->lock);
+    if(pa == 0){
+      swap.p = (swap.p + 1) % NPROC;
+      swap.va = 0;
+      passes++;
+      continue;
+    }
+    slotblocks(s, blockno);
+    bpagerw(swap.dev, blockno, (uchar*)pa, 1);
+    slotdone(s);
+    kfree((void*)pa);
+    s = -1;
+    freed++;
+    __sync_fetch_and_add(&swap.nout, 1);
+  }
+  releasesleep(&swap.hand);
+  if(s >= 0){
+    swapfree(s);
+    slotdone(s);
+  }
+  return freed;
+}
+
+// Allocate a page of user memory, zeroed if zero is set. If
+// there's none, swap some out to make room, unless holding a
+// spinlock. Returns 0 if that doesn't help either.
+void*
+ualloc(int zero)
+{
+  void *mem;
+  int i;
+
+  for(i = 0; ; i++){
+    if((mem = zero ? kalloc_zero() : kalloc()) != 0)
+      return mem;
+    // other CPUs may take the freed pages first.
+    if(i == 3 || swap.nslot == 0 || holdingspin() || swapout(SWAPBATCH) == 0)
+      return 0;
+  }
+}
+
+// Read back the swapped-out page at va in pagetable, which
+// must be the current process's, and map it again. Returns
+// its physical address, or 0.
+uint64
+swapin(pagetable_t pagetable, uint64 va)
+{
+  uint blockno[BPP];
+  pte_t *pte;
+  char *mem;
+  uint s;
+
+  if((mem = ualloc(0)) == 0)
+    return 0;
+  // ualloc() may have slept, but other processes don't touch
+  // a PTE that's already swapped out.
+  if((pte = walk(pagetable, va, 0)) == 0 || (*pte & PTE_SWAP) == 0){
+    kfree(mem);
+    return 0;
+  }
+  s = PTE2SLOT(*pte);
+  acquire(&swap.lock);
+  while(swap.slot[s] & SLOTBUSY)
+    sleep(&swap.slot[s], &swap.lock);
+  release(&swap.lock);
+  slotblocks(s, blockno);
+  bpagerw(swap.dev, blockno, (uchar*)mem, 0);
+  *pte = PA2PTE(mem) | (*pte & (PTE_R|PTE_W|PTE_X|PTE_U)) | PTE_V;
+  swapfree(s);
+  __sync_fetch_and_add(&swap.nin, 1);
+  return (uint64)mem;
+}
+
+int
+swapstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "swap: %d/%d pages used, %d out, %d in, %d full\n",
+                  swap.nused, swap.nslot, swap.nout, swap.nin, swap.nfull);
+}
@@ -104,6 +104,19 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_sync(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_tee(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_vfork(void);
+extern uint64 sys_spawn(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +140,19 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_sync]    sys_sync,
+[SYS_fcntl]   sys_fcntl,
+[SYS_splice]  sys_splice,
+[SYS_tee]     sys_tee,
+[SYS_sendfile] sys_sendfile,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_vfork]   sys_vfork,
+[SYS_spawn]   sys_spawn,
 };
 
 void
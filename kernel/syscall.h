@@ -20,3 +20,16 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_sync   22
+#define SYS_fcntl  23
+#define SYS_splice 24
+#define SYS_tee    25
+#define SYS_sendfile 26
+#define SYS_pread  27
+#define SYS_pwrite 28
+#define SYS_readv  29
+#define SYS_writev 30
+#define SYS_mmap   31
+#define SYS_munmap 32
+#define SYS_vfork  33
+#define SYS_spawn  34
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -75,7 +76,7 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
-  return fileread(f, p, n);
+  return fileread(f, 1, p, n);
 }
 
 uint64
@@ -88,7 +89,85 @@ sys_write(void)
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  return filewrite(f, 1, p, n);
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepread(f, 1, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepwrite(f, 1, p, n, off);
+}
+
+// fetch the iovec array at user address uiov. No buffer may
+// be longer than a file can be, and the lengths must add up
+// to no more than the int that readv() and writev() return.
+static int
+argiov(uint64 uiov, struct iovec *iov, int cnt)
+{
+  uint64 total;
+  int i;
+
+  if(cnt < 0 || cnt > MAXIOV)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, cnt * sizeof(*iov)) < 0)
+    return -1;
+  total = 0;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len > MAXFILE*BSIZE)
+      return -1;
+    total += iov[i].iov_len;
+  }
+  if(total > 0x7fffffff)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &cnt) < 0)
+    return -1;
+  if(argiov(p, iov, cnt) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &cnt) < 0)
+    return -1;
+  if(argiov(p, iov, cnt) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
 }
 
 uint64
@@ -322,6 +401,14 @@ sys_open(void)
     return -1;
   }
 
+  // a program being run is paged in from its file, which
+  // mustn't change under it, nor be truncated.
+  if(ip->ntext > 0 && (omode & (O_WRONLY | O_RDWR | O_TRUNC))){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
       fileclose(f);
@@ -412,19 +499,27 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+static void
+freeargv(char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
+    kfree(argv[i]);
+}
+
+// Copy the user argv array at uargv, and its strings, into
+// argv[MAXARG], a page per string. Returns 0, or -1 with
+// nothing left allocated.
+static int
+fetchargv(uint64 uargv, char **argv)
+{
+  int i;
+  uint64 uarg;
+
+  memset(argv, 0, MAXARG * sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -440,18 +535,64 @@ sys_exec(void)
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
       goto bad;
   }
+  return 0;
 
-  int ret = exec(path, argv);
+ bad:
+  freeargv(argv);
+  return -1;
+}
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
 
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  int ret = exec(path, argv);
+
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// spawn(path, argv, fds): start a child running path, whose
+// descriptors 0, 1 and 2 are fds[0], fds[1] and fds[2], or
+// closed where those are -1. With fds 0, they are 0, 1 and 2.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv, ufds;
+  int fd[3], i, ret;
+  struct file *f[3];
+  struct proc *p = myproc();
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 || argaddr(2, &ufds) < 0){
+    return -1;
+  }
+  for(i = 0; i < 3; i++)
+    fd[i] = i;
+  if(ufds && copyin(p->pagetable, (char*)fd, ufds, sizeof(fd)) < 0)
+    return -1;
+  for(i = 0; i < 3; i++){
+    f[i] = 0;
+    if(fd[i] == -1)
+      continue;
+    if(fd[i] < 0 || fd[i] >= NOFILE || (f[i] = p->ofile[fd[i]]) == 0)
+      return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  ret = spawn(path, argv, f);
+
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -484,3 +625,161 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// Write all committed file system changes to their
+// home locations on disk.
+uint64
+sys_sync(void)
+{
+  pflush(1);
+  log_checkpoint(1);
+  bflush(1);
+  return 0;
+}
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETPIPE_SZ:
+    if(f->type != FD_PIPE)
+      return -1;
+    return pipegetsize(f->pipe);
+  case F_SETPIPE_SZ:
+    if(f->type != FD_PIPE)
+      return -1;
+    return pipesetsize(f->pipe, arg);
+  }
+  return -1;
+}
+
+// Move up to n bytes from one file to another without
+// copying them through user space. One of them must be
+// a pipe, and data moves straight between the pipe's ring
+// and the other file.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_PIPE){
+    if(out->type == FD_PIPE && out->pipe == in->pipe)
+      return -1;
+    return pipeout(in->pipe, out, n, 0);
+  }
+  if(out->type == FD_PIPE)
+    return pipein(out->pipe, in, n);
+  return -1;
+}
+
+// Copy up to n bytes from one pipe to another, leaving
+// them in the first.
+uint64
+sys_tee(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type != FD_PIPE || out->type != FD_PIPE || out->pipe == in->pipe)
+    return -1;
+  return pipeout(in->pipe, out, n, 1);
+}
+
+// Copy up to count bytes from file in_fd to out_fd, through
+// a kernel buffer rather than user memory. If offset isn't
+// null, read from *offset and advance it, leaving in_fd's
+// own offset alone.
+uint64
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  uint64 offp;
+  int count, n, r, w, total;
+  uint off;
+  char *buf;
+  struct proc *p = myproc();
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+     argaddr(2, &offp) < 0 || argint(3, &count) < 0)
+    return -1;
+  if(in->readable == 0 || out->writable == 0 || in->type != FD_INODE || count < 0)
+    return -1;
+  if(offp == 0)
+    off = in->off;
+  else if(copyin(p->pagetable, (char*)&off, offp, sizeof(off)) < 0)
+    return -1;
+  if((buf = kalloc()) == 0)
+    return -1;
+
+  for(total = 0; total < count; total += w){
+    n = count - total;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    ilock(in->ip);
+    r = readi(in->ip, 0, (uint64)buf, off, n);
+    iunlock(in->ip);
+    if(r <= 0)
+      break;
+    if((w = filewrite(out, 0, (uint64)buf, r)) <= 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    off += w;
+    if(w < r){
+      total += w;
+      break;
+    }
+  }
+  kfree(buf);
+
+  if(offp == 0)
+    in->off = off;
+  else if(copyout(p->pagetable, offp, (char*)&off, sizeof(off)) < 0)
+    return -1;
+  return total;
+}
+
+// Map a file. The address argument is only a hint, and is
+// ignored: the kernel picks where the mapping goes.
+uint64
+sys_mmap(void)
+{
+  struct file *f;
+  uint64 addr;
+  int len, prot, flags, off;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0)
+    return -1;
+  return vmamap(f, len, prot, flags, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr;
+  int len;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  if(len <= 0)
+    return -1;
+  return vmaunmap(addr, len);
+}
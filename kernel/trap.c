@@ -67,6 +67,19 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault: perhaps a page of an mmap()ed file that
+    // hasn't been read in yet, or one that was swapped out.
+    // reading it may sleep.
+    uint64 scause = r_scause();
+    uint64 va = r_stval();
+    int access = scause == 12 ? PTE_X : scause == 15 ? PTE_W : PTE_R;
+    intr_on();
+    if(vmafault(p->pagetable, va, access) == 0){
+      printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, va);
+      p->killed = 1;
+    }
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
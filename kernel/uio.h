@@ -0,0 +1,5 @@
+// one buffer of a readv()/writev() vector.
+struct iovec {
+  void *iov_base;  // start of buffer
+  uint64 iov_len;  // bytes in buffer
+};
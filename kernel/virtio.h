@@ -27,6 +27,7 @@
 #define VIRTIO_MMIO_INTERRUPT_STATUS	0x060 // read-only
 #define VIRTIO_MMIO_INTERRUPT_ACK	0x064 // write-only
 #define VIRTIO_MMIO_STATUS		0x070 // read/write
+#define VIRTIO_MMIO_CONFIG		0x100 // device-specific config space
 
 // status register bits, from qemu virtio_config.h
 #define VIRTIO_CONFIG_S_ACKNOWLEDGE	1
@@ -43,6 +44,10 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
+// block device config word holding num_queues (uint16, at
+// byte 34) in its high half.
+#define VIRTIO_BLK_CONFIG_NUM_QUEUES 32
+
 // this many virtio descriptors.
 // must be a power of two.
 #define NUM 8
@@ -55,6 +60,9 @@ struct VRingDesc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr points to a table of descriptors
+
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // in avail[0]: don't interrupt
 
 struct VRingUsedElem {
   uint32 id;   // index of start of completed descriptor chain
@@ -65,6 +73,15 @@ struct VRingUsedElem {
 #define VIRTIO_BLK_T_IN  0 // read the disk
 #define VIRTIO_BLK_T_OUT 1 // write the disk
 
+// the format of the first descriptor in a disk request.
+// to be followed by descriptors for the data, and
+// a final descriptor for a one-byte status.
+struct virtio_blk_outhdr {
+  uint32 type; // VIRTIO_BLK_T_IN or ..._OUT
+  uint32 reserved;
+  uint64 sector;
+};
+
 struct UsedArea {
   uint16 flags;
   uint16 id;
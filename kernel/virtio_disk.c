@@ -3,7 +3,11 @@
 // uses qemu's mmio interface to virtio.
 // qemu presents a "legacy" virtio interface.
 //
-// qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
+// qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0,num-queues=3
+//
+// if the device offers VIRTIO_BLK_F_MQ, each CPU submits to
+// its own virtqueue, with its own lock, up to one queue per
+// CPU. the queues share the device's single interrupt.
 //
 
 #include "types.h"
@@ -20,19 +24,51 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
-static struct disk {
- // memory for virtio descriptors &c for queue 0.
- // this is a global instead of allocated because it must
- // be multiple contiguous pages, which kalloc()
- // doesn't support, and page aligned.
-  char pages[2*PGSIZE];
+// descriptors in each request's indirect table: one for
+// the header, one per block, and one for the status. so a
+// request can carry NINDDESC-2 blocks, or NUM-2 if the
+// device can't do indirect descriptors.
+#define NINDDESC 32
+
+// how a submitter waits for its request to complete. the
+// kernel boots in DISKMODE (param.h); writing "diskmode intr",
+// "diskmode poll" or "diskmode hybrid" to /stats switches.
+#define DISK_INTR   0  // sleep until the completion interrupt
+#define DISK_POLL   1  // spin on the used ring; interrupts off
+#define DISK_HYBRID 2  // spin for up to POLLUS, then sleep
+#define NMODE       3
+
+#define POLLUS     50  // hybrid mode's spin, in microseconds
+
+// latency histogram buckets: bucket 0 counts requests
+// taking under 1us, bucket i those under 2^i us.
+#define NHIST      16
+
+static char *modename[NMODE] = {
+[DISK_INTR]   "intr",
+[DISK_POLL]   "poll",
+[DISK_HYBRID] "hybrid",
+};
+
+struct vq {
+ // memory for virtio descriptors &c for this queue:
+ // two contiguous pages, from kalloc_pages(1).
+  char *pages;
   struct VRingDesc *desc;
   uint16 *avail;
   struct UsedArea *used;
 
   // our own book-keeping.
+  int qn;          // queue number
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used[2..NUM].
+  uint16 used_idx; // we've looked this far in used->elems[].
+
+  // with VIRTIO_RING_F_INDIRECT_DESC, each request takes a
+  // single ring descriptor, pointing to a table here
+  // (indexed by that descriptor) holding the actual chain.
+  struct VRingDesc ind[NUM][NINDDESC];
+  int nflight;  // requests at the device
+  uint depth[NUM+1]; // nflight counts seen by submit()
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
@@ -40,19 +76,75 @@ static struct disk {
   struct {
     struct buf *b;
     char status;
+    uint64 start; // time of submission
+    struct virtio_blk_outhdr hdr; // the request's header
   } info[NUM];
+
+  uint hist[NMODE][NHIST]; // request latencies, per mode
   
   struct spinlock vdisk_lock;
   
-} __attribute__ ((aligned (PGSIZE))) disk;
+};
+
+static struct disk {
+  struct vq vq[NCPU];
+  int nvq;     // queues in use
+  int indirect;
+  int maxseg;  // most blocks in one request
+  int mode;    // DISK_INTR, DISK_POLL, or DISK_HYBRID
+} disk;
+
+// set up virtqueue qn.
+static void
+vqinit(struct vq *vq, int qn)
+{
+  initlock(&vq->vdisk_lock, "virtio_disk");
+  vq->qn = qn;
+
+  *R(VIRTIO_MMIO_QUEUE_SEL) = qn;
+  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  if(max == 0)
+    panic("virtio disk has no queue");
+  if(max < NUM)
+    panic("virtio disk max queue too short");
+  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  if((vq->pages = kalloc_pages(1)) == 0)
+    panic("virtio disk queue");
+  memset(vq->pages, 0, 2*PGSIZE);
+  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)vq->pages) >> PGSHIFT;
+
+  // desc = pages -- num * VRingDesc
+  // avail = pages + 0x40 -- 2 * uint16, then num * uint16
+  // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
+
+  vq->desc = (struct VRingDesc *) vq->pages;
+  vq->avail = (uint16*)(((char*)vq->desc) + NUM*sizeof(struct VRingDesc));
+  vq->used = (struct UsedArea *) (vq->pages + PGSIZE);
+
+  for(int i = 0; i < NUM; i++)
+    vq->free[i] = 1;
+
+  if(disk.mode == DISK_POLL)
+    vq->avail[0] = VRING_AVAIL_F_NO_INTERRUPT; // we'll look for ourselves
+}
+
+// the index of the calling CPU's queue.
+int
+virtio_disk_queue(void)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  pop_off();
+  return id % disk.nvq;
+}
 
 void
 virtio_disk_init(void)
 {
   uint32 status = 0;
 
-  initlock(&disk.vdisk_lock, "virtio_disk");
-
   if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
      *R(VIRTIO_MMIO_VERSION) != 1 ||
      *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
@@ -71,11 +163,19 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
-  features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.indirect = (features >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
+  disk.maxseg = disk.indirect ? NINDDESC-2 : NUM-2;
+  disk.nvq = 1;
+  if(features & (1 << VIRTIO_BLK_F_MQ)){
+    disk.nvq = *R(VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CONFIG_NUM_QUEUES) >> 16;
+    if(disk.nvq < 1)
+      disk.nvq = 1;
+    if(disk.nvq > NCPU)
+      disk.nvq = NCPU;
+  }
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -87,38 +187,20 @@ virtio_disk_init(void)
 
   *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
 
-  // initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
-  if(max == 0)
-    panic("virtio disk has no queue 0");
-  if(max < NUM)
-    panic("virtio disk max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
-  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
-
-  // desc = pages -- num * VRingDesc
-  // avail = pages + 0x40 -- 2 * uint16, then num * uint16
-  // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
-
-  disk.desc = (struct VRingDesc *) disk.pages;
-  disk.avail = (uint16*)(((char*)disk.desc) + NUM*sizeof(struct VRingDesc));
-  disk.used = (struct UsedArea *) (disk.pages + PGSIZE);
-
-  for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+  disk.mode = DISKMODE;
+  for(int i = 0; i < disk.nvq; i++)
+    vqinit(&disk.vq[i], i);
 
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
 
 // find a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct vq *vq)
 {
   for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
+    if(vq->free[i]){
+      vq->free[i] = 0;
       return i;
     }
   }
@@ -127,144 +209,357 @@ alloc_desc()
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct vq *vq, int i)
 {
   if(i >= NUM)
     panic("virtio_disk_intr 1");
-  if(disk.free[i])
+  if(vq->free[i])
     panic("virtio_disk_intr 2");
-  disk.desc[i].addr = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  vq->desc[i].addr = 0;
+  vq->free[i] = 1;
+  wakeup(&vq->free[0]);
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct vq *vq, int i)
 {
   while(1){
-    free_desc(i);
-    if(disk.desc[i].flags & VRING_DESC_F_NEXT)
-      i = disk.desc[i].next;
+    free_desc(vq, i);
+    if(vq->desc[i].flags & VRING_DESC_F_NEXT)
+      i = vq->desc[i].next;
     else
       break;
   }
 }
 
+// find n free descriptors, mark them non-free, and put
+// their indices in idx[]. returns -1, allocating nothing,
+// if there aren't enough free descriptors.
 static int
-alloc3_desc(int *idx)
+alloc_descs(struct vq *vq, int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
+  for(int i = 0; i < n; i++){
+    idx[i] = alloc_desc(vq);
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
+        free_desc(vq, idx[j]);
       return -1;
     }
   }
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// format the descriptor chain for a request that transfers
+// the n bufs in b[], which hold consecutive blocks, and hand
+// it to the device. idx[] holds the ring descriptors that
+// alloc_descs() found for it: one if disk.indirect, else
+// n+2.
+static void
+submit(struct vq *vq, struct buf **b, int n, int write, int *idx)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
-
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+  struct VRingDesc *d;
+  int head = idx[0];
+  struct virtio_blk_outhdr *hdr = &vq->info[head].hdr;
+  int tab[NINDDESC];
+
+  if(disk.indirect){
+    // the chain goes in head's indirect table.
+    d = vq->ind[head];
+    for(int i = 0; i < n+2; i++)
+      tab[i] = i;
+    idx = tab;
+    vq->desc[head].addr = (uint64) d;
+    vq->desc[head].len = (n+2) * sizeof(struct VRingDesc);
+    vq->desc[head].flags = VRING_DESC_F_INDIRECT;
+    vq->desc[head].next = 0;
+  } else {
+    d = vq->desc;
   }
-  
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  // the spec says that legacy block operations use one
+  // descriptor for type/reserved/sector, one for each data
+  // segment, and one for a 1-byte status result.
+  // qemu's virtio-blk.c reads them.
 
   if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
+    hdr->type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+    hdr->type = VIRTIO_BLK_T_IN; // read the disk
+  hdr->reserved = 0;
+  hdr->sector = b[0]->blockno * (BSIZE / 512);
+
+  // hdr is in the direct-mapped kernel data, so its
+  // virtual address is its physical address.
+  d[idx[0]].addr = (uint64) hdr;
+  d[idx[0]].len = sizeof(*hdr);
+  d[idx[0]].flags = VRING_DESC_F_NEXT;
+  d[idx[0]].next = idx[1];
+
+  for(int i = 0; i < n; i++){
+    d[idx[1+i]].addr = (uint64) b[i]->data;
+    d[idx[1+i]].len = BSIZE;
+    if(write)
+      d[idx[1+i]].flags = 0; // device reads b->data
+    else
+      d[idx[1+i]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    d[idx[1+i]].flags |= VRING_DESC_F_NEXT;
+    d[idx[1+i]].next = idx[2+i];
+  }
 
-  disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  vq->info[head].status = 0;
+  d[idx[n+1]].addr = (uint64) &vq->info[head].status;
+  d[idx[n+1]].len = 1;
+  d[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d[idx[n+1]].next = 0;
 
   // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // completion of the whole request is signalled through b[0].
+  b[0]->disk = 1;
+  vq->info[head].b = b[0];
+  vq->info[head].start = r_time();
+  vq->depth[++vq->nflight]++;
 
   // avail[0] is flags
   // avail[1] tells the device how far to look in avail[2...].
   // avail[2...] are desc[] indices the device should process.
   // we only tell device the first index in our chain of descriptors.
-  disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
+  vq->avail[2 + (vq->avail[1] % NUM)] = head;
+  __sync_synchronize();
+  vq->avail[1] = vq->avail[1] + 1;
+
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = vq->qn; // value is queue number
+}
+
+// look in the used ring for completed requests, and
+// wake up their submitters.
+static void
+drain(struct vq *vq)
+{
   __sync_synchronize();
-  disk.avail[1] = disk.avail[1] + 1;
+  // compare the full 16-bit indices: with all NUM requests
+  // done at once, they differ by a multiple of NUM.
+  while(vq->used_idx != vq->used->id){
+    int id = vq->used->elems[vq->used_idx % NUM].id;
+
+    if(vq->info[id].status != 0)
+      panic("virtio_disk_intr status");
+    
+    vq->info[id].b->disk = 0;   // disk is done with buf
+    wakeup(vq->info[id].b);
+
+    vq->used_idx += 1;
+  }
+}
+
+// count a request that took t time units in the
+// histogram of the mode it was waited for in.
+static void
+record(struct vq *vq, uint64 t, int mode)
+{
+  int i;
+
+  t /= TIMEPERUS;
+  for(i = 0; t > 0 && i < NHIST-1; i++)
+    t >>= 1;
+  vq->hist[mode][i]++;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// wait for the request whose chain starts at descriptor
+// head to finish, then release its descriptors.
+static void
+finish(struct vq *vq, int head)
+{
+  struct buf *b = vq->info[head].b;
+  uint64 t0 = r_time();
+  int mode = disk.mode;  // may change meanwhile; see virtio_disk_setmode()
+
+  // Check the used ring ourselves, dropping the lock between
+  // looks so that other CPUs and interrupts can get in.
+  if(mode != DISK_INTR){
+    while(b->disk == 1){
+      drain(vq);
+      if(b->disk == 0)
+        break;
+      if(mode == DISK_HYBRID && r_time() - t0 >= POLLUS*TIMEPERUS)
+        break;
+      release(&vq->vdisk_lock);
+      acquire(&vq->vdisk_lock);
+    }
+  }
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  // Wait for virtio_disk_intr() to say request has finished,
+  // unless the queue has since been switched to polling,
+  // when no interrupt will come.
   while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+    if(disk.mode == DISK_POLL){
+      drain(vq);
+      release(&vq->vdisk_lock);
+      acquire(&vq->vdisk_lock);
+    } else
+      sleep(b, &vq->vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  record(vq, r_time() - vq->info[head].start, mode);
+  vq->nflight--;
+  vq->info[head].b = 0;
+  free_chain(vq, head);
+}
 
-  release(&disk.vdisk_lock);
+// Read or write the n locked bufs in b[], through queue q
+// (see virtio_disk_queue()). Each run of bufs
+// holding consecutive blocks goes to the device as a single
+// multi-block request, and as many requests are kept in
+// flight as there are descriptors for. Returns once all of
+// them have completed.
+void
+virtio_disk_rwv(int q, struct buf **b, int n, int write)
+{
+  int inflight[NUM]; // head descriptors of our requests, oldest first
+  int nflight = 0, oldest = 0;
+  int idx[NUM];
+  int i, len;
+  struct vq *vq = &disk.vq[q];
+
+  acquire(&vq->vdisk_lock);
+
+  for(i = 0; i < n; i += len){
+    for(len = 1; i + len < n && len < disk.maxseg; len++){
+      if(b[i+len]->dev != b[i]->dev ||
+         b[i+len]->blockno != b[i+len-1]->blockno + 1)
+        break;
+    }
+
+    // allocate the descriptors. if our own requests are
+    // holding them, retire the oldest one rather than
+    // waiting on ourselves.
+    while(alloc_descs(vq, idx, disk.indirect ? 1 : len + 2) != 0){
+      if(nflight > 0){
+        finish(vq, inflight[oldest]);
+        oldest = (oldest + 1) % NUM;
+        nflight--;
+      } else {
+        sleep(&vq->free[0], &vq->vdisk_lock);
+      }
+    }
+
+    submit(vq, b + i, len, write, idx);
+    inflight[(oldest + nflight) % NUM] = idx[0];
+    nflight++;
+  }
+
+  while(nflight > 0){
+    finish(vq, inflight[oldest]);
+    oldest = (oldest + 1) % NUM;
+    nflight--;
+  }
+
+  release(&vq->vdisk_lock);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_rwv(virtio_disk_queue(), &b, 1, write);
 }
 
+// all queues share the interrupt, so look at each of them.
+// acknowledge first, so that a completion arriving during the
+// scan raises a fresh interrupt rather than being lost.
 void
 virtio_disk_intr()
 {
-  acquire(&disk.vdisk_lock);
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  __sync_synchronize();
 
-  while((disk.used_idx % NUM) != (disk.used->id % NUM)){
-    int id = disk.used->elems[disk.used_idx].id;
+  for(int i = 0; i < disk.nvq; i++){
+    acquire(&disk.vq[i].vdisk_lock);
+    drain(&disk.vq[i]);
+    release(&disk.vq[i].vdisk_lock);
+  }
+}
 
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
-    
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+// Switch to the completion mode called name. Returns -1 if
+// there's no such mode.
+int
+virtio_disk_setmode(char *name)
+{
+  int m, i;
+  struct vq *vq;
 
-    disk.used_idx = (disk.used_idx + 1) % NUM;
+  for(m = 0; m < NMODE; m++)
+    if(strncmp(name, modename[m], 8) == 0)
+      break;
+  if(m == NMODE)
+    return -1;
+
+  // with every queue locked, no request is between looking
+  // at the mode and waiting.
+  for(vq = disk.vq; vq < &disk.vq[disk.nvq]; vq++)
+    acquire(&vq->vdisk_lock);
+  disk.mode = m;
+  for(vq = disk.vq; vq < &disk.vq[disk.nvq]; vq++){
+    vq->avail[0] = m == DISK_POLL ? VRING_AVAIL_F_NO_INTERRUPT : 0;
+    // waiters asleep for an interrupt that won't come now
+    // must poll instead.
+    for(i = 0; i < NUM; i++)
+      if(vq->info[i].b)
+        wakeup(vq->info[i].b);
+  }
+  __sync_synchronize();
+  for(vq = disk.vq; vq < &disk.vq[disk.nvq]; vq++)
+    release(&vq->vdisk_lock);
+  return 0;
+}
+
+// print the configuration, the requests sent to each queue
+// and how many were in flight in their queue at the time,
+// and a line per completion mode that has been used, with
+// its request count and latency histogram.
+int
+virtio_disk_stats(char *buf, int sz)
+{
+  uint hist[NMODE][NHIST];
+  uint depth[NUM+1];
+  uint nreq[NCPU];
+  struct vq *vq;
+  int m, i, n, off;
+
+  memset(hist, 0, sizeof(hist));
+  memset(depth, 0, sizeof(depth));
+  for(vq = disk.vq; vq < &disk.vq[disk.nvq]; vq++){
+    acquire(&vq->vdisk_lock);
+    nreq[vq->qn] = 0;
+    for(i = 0; i <= NUM; i++){
+      depth[i] += vq->depth[i];
+      nreq[vq->qn] += vq->depth[i];
+    }
+    for(m = 0; m < NMODE; m++)
+      for(i = 0; i < NHIST; i++)
+        hist[m][i] += vq->hist[m][i];
+    release(&vq->vdisk_lock);
   }
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
-  release(&disk.vdisk_lock);
+  off = snprintf(buf, sz, "disk: mode %s, %d queues, reqs", modename[disk.mode], disk.nvq);
+  for(i = 0; i < disk.nvq; i++)
+    off += snprintf(buf+off, sz-off, " %d", nreq[i]);
+  off += snprintf(buf+off, sz-off, "; %s descriptors, %d blocks/req, depth",
+                  disk.indirect ? "indirect" : "direct", disk.maxseg);
+  for(i = 1; i <= NUM; i++)
+    if(depth[i])
+      off += snprintf(buf+off, sz-off, " %d:%d", i, depth[i]);
+  off += snprintf(buf+off, sz-off, "\n");
+  for(m = 0; m < NMODE; m++){
+    n = 0;
+    for(i = 0; i < NHIST; i++)
+      n += hist[m][i];
+    if(n == 0 && m != disk.mode)
+      continue;
+    off += snprintf(buf+off, sz-off, "disk %s: %d reqs, us", modename[m], n);
+    for(i = 0; i < NHIST; i++)
+      if(hist[m][i])
+        off += snprintf(buf+off, sz-off, " <%d:%d", 1 << i, hist[m][i]);
+    off += snprintf(buf+off, sz-off, "\n");
+  }
+  return off;
 }
@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -56,6 +58,29 @@ kvminithart()
   sfence_vma();
 }
 
+// Like walk() below, but return the PTE at level leaf (0, 1
+// or 2) rather than at level 0, or a larger leaf covering va.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int leaf, int alloc)
+{
+  if(va >= MAXVA)
+    panic("walk");
+
+  for(int level = 2; level > leaf; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return pte;
+      pagetable = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if(!alloc || (pagetable = (pde_t*)kalloc_zero()) == 0)
+        return 0;
+      *pte = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+  return &pagetable[PX(leaf, va)];
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -68,24 +93,42 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A leaf PTE at level 1 or 2 maps a 2MB megapage or a 1GB
+// gigapage. walk() returns such a PTE if one covers va.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
-  if(va >= MAXVA)
-    panic("walk");
+  return walklevel(pagetable, va, 0, alloc);
+}
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
-    if(*pte & PTE_V) {
-      pagetable = (pagetable_t)PTE2PA(*pte);
-    } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
-        return 0;
-      memset(pagetable, 0, PGSIZE);
-      *pte = PA2PTE(pagetable) | PTE_V;
-    }
+// Return the leaf PTE that maps va, which may be a
+// superpage, and set *level to its level; or 0 if va
+// isn't mapped.
+pte_t *
+walkleaf(pagetable_t pagetable, uint64 va, int *level)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    return 0;
+  for(*level = 2; *level >= 0; (*level)--){
+    pte = &pagetable[PX(*level, va)];
+    if((*pte & PTE_V) == 0)
+      return 0;
+    if(PTE_LEAF(*pte))
+      return pte;
+    pagetable = (pagetable_t)PTE2PA(*pte);
   }
-  return &pagetable[PX(0, va)];
+  return 0;
+}
+
+// The physical address of the 4KB page holding va, which leaf
+// PTE pte at level maps.
+static uint64
+leafpa(pte_t pte, int level, uint64 va)
+{
+  return PTE2PA(pte) + PGROUNDDOWN(va % LEVELSIZE(level));
 }
 
 // Look up a virtual address, return the physical address,
@@ -95,20 +138,14 @@ uint64
 walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
-  uint64 pa;
-
-  if(va >= MAXVA)
-    return 0;
+  int level;
 
-  pte = walk(pagetable, va, 0);
+  pte = walkleaf(pagetable, va, &level);
   if(pte == 0)
     return 0;
-  if((*pte & PTE_V) == 0)
-    return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
-  return pa;
+  return leafpa(*pte, level, va);
 }
 
 // add a mapping to the kernel page table.
@@ -122,88 +159,193 @@ kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
 }
 
 // translate a kernel virtual address to
-// a physical address. only needed for
-// addresses on the stack.
-// assumes va is page aligned.
+// a physical address, for devices that do DMA.
+// direct-mapped addresses translate to themselves,
+// and kernel stacks through kstackpa(); anything
+// else takes a page-table walk.
 uint64
 kvmpa(uint64 va)
 {
-  uint64 off = va % PGSIZE;
   pte_t *pte;
   uint64 pa;
+  int level;
+
+  if(va >= KERNBASE && va < PHYSTOP)
+    return va;
+  if((pa = kstackpa(va)) != 0)
+    return pa;
   
-  pte = walk(kernel_pagetable, va, 0);
-  if(pte == 0)
+  // the leaf may be a superpage.
+  if((pte = walkleaf(kernel_pagetable, va, &level)) == 0)
     panic("kvmpa");
-  if((*pte & PTE_V) == 0)
-    panic("kvmpa");
-  pa = PTE2PA(*pte);
-  return pa+off;
+  return leafpa(*pte, level, va) + va % PGSIZE;
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
+// be page-aligned. Where va and pa are both aligned to 2MB or
+// 1GB and the range covers a whole megapage or gigapage, and
+// no smaller mappings are there already, one superpage PTE
+// maps it. Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
   uint64 a, last;
   pte_t *pte;
+  int level;
 
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
-      return -1;
+    // the largest page that fits.
+    for(level = SUPERPAGE ? 2 : 0; ; level--){
+      if(level > 0 && (a % LEVELSIZE(level) != 0 || pa % LEVELSIZE(level) != 0 ||
+                       last - a < LEVELSIZE(level) - PGSIZE))
+        continue;
+      if((pte = walklevel(pagetable, a, level, 1)) == 0)
+        return -1;
+      if(level > 0 && (*pte & PTE_V) && !PTE_LEAF(*pte))
+        continue;  // already split into smaller pages
+      break;
+    }
     if(*pte & PTE_V)
       panic("remap");
     *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
+    if(last - a < LEVELSIZE(level))
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += LEVELSIZE(level);
+    pa += LEVELSIZE(level);
   }
   return 0;
 }
 
+// Transparent huge page counters, for the statistics device.
+static struct {
+  int nmapped;   // megapages in user page tables now
+  int nalloc;    // megapages ever mapped
+  int nsplit;    // megapages split to be partly unmapped
+  int nfallback; // aligned 2MB regions mapped with 4KB pages
+} thp;
+
+// Is va in one of the parts of a program that exec() left to
+// be paged in? seg is a process's NSEG of them, or 0.
+static int
+inseg(struct seg *seg, uint64 va)
+{
+  int i;
+
+  if(seg == 0)
+    return 0;
+  for(i = 0; i < NSEG; i++)
+    if(seg[i].len && va >= seg[i].va && va < seg[i].va + seg[i].len)
+      return 1;
+  return 0;
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned, and a megapage must be removed whole. Pages
+// in seg that were never paged in aren't mapped, and are
+// skipped.
+// Optionally free the physical memory, or the swap slot of
+// a page that was swapped out.
 void
-uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free, struct seg *seg)
 {
-  uint64 a;
+  uint64 a, end;
   pte_t *pte;
+  int level;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
-    if(PTE_FLAGS(*pte) == PTE_V)
-      panic("uvmunmap: not a leaf");
+  end = va + npages*PGSIZE;
+  for(a = va; a < end; a += LEVELSIZE(level)){
+    if((pte = walkleaf(pagetable, a, &level)) == 0){
+      level = 0;
+      if((pte = walk(pagetable, a, 0)) != 0 && (*pte & PTE_SWAP)){
+        if(do_free)
+          swapfree(PTE2SLOT(*pte));
+        *pte = 0;
+      } else if(!inseg(seg, a))
+        panic("uvmunmap: not mapped");
+      continue;
+    }
+    if(level > 1 || a % LEVELSIZE(level) != 0 || end - a < LEVELSIZE(level))
+      panic("uvmunmap: part of a megapage");
     if(do_free){
       uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      if(level == 1){
+        kfree_huge((void*)pa);
+        __sync_fetch_and_add(&thp.nmapped, -1);
+      } else if(*pte & PTE_TEXT)
+        ptextunmap(pa);
+      else
+        kfree((void*)pa);
     }
     *pte = 0;
   }
 }
 
+// Split the megapage that maps va, if there is one, into 512
+// 4KB pages, so that part of it can be unmapped; its pages are
+// then freed one at a time. Returns -1 if there's no memory
+// for the new page-table page.
+static int
+uvmsplit(pagetable_t pagetable, uint64 va)
+{
+  pagetable_t pt;
+  pte_t *pte;
+  uint64 pa;
+  int level, i;
+
+  if((pte = walkleaf(pagetable, va, &level)) == 0 || level == 0)
+    return 0;
+  if(level != 1)
+    panic("uvmsplit");
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  for(i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | PTE_FLAGS(*pte);
+  *pte = PA2PTE(pt) | PTE_V;
+  __sync_fetch_and_add(&thp.nmapped, -1);
+  __sync_fetch_and_add(&thp.nsplit, 1);
+  return 0;
+}
+
+// Could a megapage map the 2MB at va? Not if smaller pages
+// were mapped there before, leaving a page-table page.
+static int
+hugefits(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+
+  if((*pte & PTE_V) == 0)
+    return 1;
+  pte = &((pagetable_t)PTE2PA(*pte))[PX(1, va)];
+  return (*pte & PTE_V) == 0;
+}
+
+// Free memory from kalloc(), or kalloc_huge() if sz is 2MB.
+static void
+freemem(void *mem, uint64 sz)
+{
+  if(sz == HUGEPGSIZE)
+    kfree_huge(mem);
+  else
+    kfree(mem);
+}
+
 // create an empty user page table.
 // returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zero();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -217,36 +359,50 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zero();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
 
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Each aligned 2MB that the growth covers entirely gets a
+// megapage, if a whole chunk of memory is free for it.
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   char *mem;
-  uint64 a;
+  uint64 a, sz;
 
   if(newsz < oldsz)
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
-  for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+  for(a = oldsz; a < newsz; a += sz){
+    sz = PGSIZE;
+    mem = 0;
+    if(SUPERPAGE && THP && a % HUGEPGSIZE == 0 && newsz - a >= HUGEPGSIZE){
+      if(hugefits(pagetable, a) && (mem = kalloc_huge()) != 0){
+        sz = HUGEPGSIZE;
+        memset(mem, 0, sz);
+      } else
+        __sync_fetch_and_add(&thp.nfallback, 1);
+    }
+    if(mem == 0)
+      mem = ualloc(1);
     if(mem == 0){
-      uvmdealloc(pagetable, a, oldsz);
+      uvmdealloc(pagetable, a, oldsz, 0);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
-    if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
-      kfree(mem);
-      uvmdealloc(pagetable, a, oldsz);
+    if(mappages(pagetable, a, sz, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+      freemem(mem, sz);
+      uvmdealloc(pagetable, a, oldsz, 0);
       return 0;
     }
+    if(sz == HUGEPGSIZE){
+      __sync_fetch_and_add(&thp.nmapped, 1);
+      __sync_fetch_and_add(&thp.nalloc, 1);
+    }
   }
   return newsz;
 }
@@ -254,16 +410,22 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size.  seg is as for
+// uvmunmap().  A megapage that would be left partly mapped is
+// split first; if there's no memory for that, nothing is freed
+// and oldsz is returned.
 uint64
-uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
+uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, struct seg *seg)
 {
   if(newsz >= oldsz)
     return oldsz;
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
+    if(PGROUNDUP(newsz) % HUGEPGSIZE != 0 && uvmsplit(pagetable, PGROUNDUP(newsz)) < 0)
+      return oldsz;
+
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
+    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1, seg);
   }
 
   return newsz;
@@ -292,46 +454,109 @@ freewalk(pagetable_t pagetable)
 // Free user memory pages,
 // then free page-table pages.
 void
-uvmfree(pagetable_t pagetable, uint64 sz)
+uvmfree(pagetable_t pagetable, uint64 sz, struct seg *seg)
 {
   if(sz > 0)
-    uvmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
+    uvmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1, seg);
   freewalk(pagetable);
 }
 
+// Between looking up a physical address in the current
+// process's page table and using it, the process may be
+// preempted, or sleep in vmafault(). Keep swapout() from
+// taking and freeing the page meanwhile.
+static void
+ucopybegin(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pagetable == pagetable)
+    p->ucopy++;
+}
+
+static void
+ucopyend(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pagetable == pagetable)
+    p->ucopy--;
+}
+
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
 // physical memory.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
+// A megapage is copied to a megapage if a chunk is free, else
+// to 4KB pages. Program text from the page cache is shared,
+// not copied, and what in seg was never paged in is left for
+// the child to page in. A page that was swapped out is read
+// back in to be copied.
 int
-uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t new, uint64 sz, struct seg *seg)
 {
   pte_t *pte;
-  uint64 pa, i;
+  uint64 i, n;
   uint flags;
   char *mem;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
+  int level;
+
+  ucopybegin(old);
+  for(i = 0; i < sz; i += n){
+    n = PGSIZE;
+    if((pte = walkleaf(old, i, &level)) == 0){
+      if((pte = walk(old, i, 0)) != 0 && (*pte & PTE_SWAP)){
+        if(swapin(old, i) == 0)
+          goto err;
+        n = 0;  // now copy it
+      } else if(!inseg(seg, i))
+        panic("uvmcopy: page not present");
+      continue;
+    }
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    if(flags & PTE_TEXT){
+      ptextdup(PTE2PA(*pte));
+      if(mappages(new, i, n, PTE2PA(*pte), flags) != 0){
+        ptextunmap(PTE2PA(*pte));
+        goto err;
+      }
+      continue;
+    }
+    mem = 0;
+    if(level == 1 && i % HUGEPGSIZE == 0){
+      if((mem = kalloc_huge()) != 0)
+        n = HUGEPGSIZE;
+      else
+        __sync_fetch_and_add(&thp.nfallback, 1);
+    }
+    if(mem == 0){
+      if((mem = ualloc(0)) == 0)
+        goto err;
+      if((*pte & PTE_V) == 0){
+        // swapped out while ualloc() made room.
+        kfree(mem);
+        n = 0;
+        continue;
+      }
+    }
+    memmove(mem, (char*)leafpa(*pte, level, i), n);
+    if(mappages(new, i, n, (uint64)mem, flags) != 0){
+      freemem(mem, n);
       goto err;
     }
+    if(n == HUGEPGSIZE){
+      __sync_fetch_and_add(&thp.nmapped, 1);
+      __sync_fetch_and_add(&thp.nalloc, 1);
+    }
   }
+  ucopyend(old);
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  ucopyend(old);
+  uvmunmap(new, 0, i / PGSIZE, 1, seg);
   return -1;
 }
 
@@ -350,17 +575,30 @@ uvmclear(pagetable_t pagetable, uint64 va)
 
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
+// The pages must be writable. mmap()ed pages not yet read in are
+// faulted in, here and in copyin().
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
+  int level, r = 0;
 
+  ucopybegin(pagetable);
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if(va0 >= MAXVA){
+      r = -1;
+      break;
+    }
+    pte = walkleaf(pagetable, va0, &level);
+    if(pte && (*pte & (PTE_V|PTE_U|PTE_W)) == (PTE_V|PTE_U|PTE_W))
+      pa0 = leafpa(*pte, level, va0);
+    else if((pa0 = vmafault(pagetable, va0, PTE_W)) == 0){
+      r = -1;
+      break;
+    }
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -370,7 +608,8 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
     src += n;
     dstva = va0 + PGSIZE;
   }
-  return 0;
+  ucopyend(pagetable);
+  return r;
 }
 
 // Copy from user to kernel.
@@ -380,12 +619,16 @@ int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  int r = 0;
 
+  ucopybegin(pagetable);
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if(pa0 == 0 && (pa0 = vmafault(pagetable, va0, PTE_R)) == 0){
+      r = -1;
+      break;
+    }
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
@@ -395,7 +638,8 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
     dst += n;
     srcva = va0 + PGSIZE;
   }
-  return 0;
+  ucopyend(pagetable);
+  return r;
 }
 
 // Copy a null-terminated string from user to kernel.
@@ -408,11 +652,12 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   uint64 n, va0, pa0;
   int got_null = 0;
 
+  ucopybegin(pagetable);
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if(pa0 == 0 && (pa0 = vmafault(pagetable, va0, PTE_R)) == 0)
+      break;
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
@@ -434,9 +679,48 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
     srcva = va0 + PGSIZE;
   }
+  ucopyend(pagetable);
   if(got_null){
     return 0;
   } else {
     return -1;
   }
 }
+
+// Count the leaf PTEs in page table pagetable at level and
+// below: 4KB pages in n[0], megapages in n[1], gigapages in
+// n[2].
+static void
+countleaves(pagetable_t pagetable, int level, int *n)
+{
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) == 0)
+      continue;
+    if(PTE_LEAF(pte))
+      n[level]++;
+    else if(level > 0)
+      countleaves((pagetable_t)PTE2PA(pte), level - 1, n);
+  }
+}
+
+// Format the kernel page table's mappings into buf, for the
+// statistics device.
+int
+kvmstats(char *buf, int sz)
+{
+  int n[3] = { 0, 0, 0 };
+
+  countleaves(kernel_pagetable, 2, n);
+  return snprintf(buf, sz, "kvm: %d 4KB pages, %d 2MB pages, %d 1GB pages\n",
+                  n[0], n[1], n[2]);
+}
+
+// Format the transparent huge page counters into buf, for the
+// statistics device.
+int
+thpstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "thp: %d megapages mapped, %d allocated, %d split, %d fallbacks\n",
+                  thp.nmapped, thp.nalloc, thp.nsplit, thp.nfallback);
+}
@@ -0,0 +1,401 @@
+//
+// Memory-mapped files: mmap() and munmap().
+//
+// Each process has a table of VMAs, regions of its address
+// space backed by a file. mmap() only records the region; a
+// page is read in from the file when first touched, by the
+// page fault in usertrap(), or by copyin()/copyout() when the
+// kernel touches it first. Regions are placed top-down from
+// just below the trapframe, and the heap may not grow into
+// them.
+//
+// A MAP_SHARED region maps the file's pages in the page
+// cache, so every process mapping the file, and read() and
+// write(), see the same data. Such a page is mapped read-only
+// at first, and made writable on the first write to it; the
+// page cache writes it back once it is dirty. A MAP_PRIVATE
+// region gets copies of the file's pages instead.
+//
+// The same fault fills in the parts of a program that exec()
+// left to be paged in, below p->sz: its text, mapped from the
+// page cache, and its bss; and reads back pages that were
+// swapped out.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "proc.h"
+#include "defs.h"
+
+// The VMA of p that contains va, or 0.
+static struct vma*
+lookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->addr && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+static struct vma*
+freevma(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->addr == 0)
+      return v;
+  return 0;
+}
+
+// The lowest address used by any of p's VMAs; the top of
+// what the heap may grow into.
+uint64
+vmabase(struct proc *p)
+{
+  struct vma *v;
+  uint64 base = TRAPFRAME;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->addr && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// Map len bytes of f, from offset off, into the current
+// process. Returns the address, or -1.
+uint64
+vmamap(struct file *f, uint64 len, int prot, int flags, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 base;
+
+  if(f->type != FD_INODE || len == 0 || off % PGSIZE != 0)
+    return -1;
+  if(p->vfork)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(!f->readable)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+
+  len = PGROUNDUP(len);
+  base = vmabase(p);
+  if(len > base || base - len < PGROUNDUP(p->sz))
+    return -1;
+  if((v = freevma(p)) == 0)
+    return -1;
+
+  v->addr = base - len;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = filedup(f);
+  v->off = off;
+  return v->addr;
+}
+
+// Remove the pages in [start, end) of v from p's page
+// table. Shared pages go back to the page cache, which
+// writes them to the file if they were written. Pages never
+// touched aren't mapped, and are skipped.
+static void
+unmaprange(struct proc *p, struct vma *v, uint64 start, uint64 end)
+{
+  uint64 a, pa;
+  pte_t *pte;
+
+  for(a = start; a < end; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    if(v->flags == MAP_SHARED)
+      punmap(pa, (*pte & PTE_W) != 0);
+    else
+      kfree((void*)pa);
+    *pte = 0;
+  }
+}
+
+// Unmap [addr, addr+len) from the current process. The range
+// may cover any part of one or more regions; splitting one in
+// two takes a free VMA slot.
+int
+vmaunmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint64 end, s, t;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  end = addr + PGROUNDUP(len);
+  if(end < addr || end > TRAPFRAME)
+    return -1;
+
+  nv = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr && addr > v->addr && end < v->addr + v->len){
+      if((nv = freevma(p)) == 0)
+        return -1;
+    }
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0)
+      continue;
+    s = addr > v->addr ? addr : v->addr;
+    t = end < v->addr + v->len ? end : v->addr + v->len;
+    if(s >= t)
+      continue;
+    unmaprange(p, v, s, t);
+    if(s == v->addr && t == v->addr + v->len){
+      fileclose(v->f);
+      v->addr = 0;
+      v->f = 0;
+    } else if(s == v->addr){
+      v->off += t - v->addr;
+      v->len -= t - v->addr;
+      v->addr = t;
+    } else if(t == v->addr + v->len){
+      v->len = s - v->addr;
+    } else {
+      *nv = *v;
+      nv->addr = t;
+      nv->len = v->addr + v->len - t;
+      nv->off = v->off + (t - v->addr);
+      nv->f = filedup(v->f);
+      v->len = s - v->addr;
+    }
+  }
+  return 0;
+}
+
+// Fill in page va of p's program, below p->sz, if it lies in
+// a part that exec() left to be paged in and allows the
+// access. Returns the page's physical address, or 0. Zeroed
+// pages can be had anywhere, but text is read in only where
+// vmafault() would read in a file.
+static uint64
+segfault(struct proc *p, uint64 va, int access)
+{
+  struct seg *s;
+  pte_t *pte;
+  uint64 pa;
+
+  for(s = p->seg; s < &p->seg[NSEG]; s++)
+    if(s->len && va >= s->va && va < s->va + s->len)
+      break;
+  if(s == &p->seg[NSEG] || (s->perm & access) != access)
+    return 0;
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return 0;
+
+  if(s->perm & PTE_TEXT){
+    if(holdingspin() || p->nilock > 0)
+      return 0;
+    ilock(p->exe);
+    pa = ptextmap(p->exe, (s->off + (va - s->va)) / PGSIZE);
+    iunlock(p->exe);
+    if(pa == 0)
+      return 0;
+  } else if((pa = (uint64)ualloc(1)) == 0){
+    return 0;
+  }
+  if(mappages(p->pagetable, va, PGSIZE, pa, s->perm) != 0){
+    if(s->perm & PTE_TEXT)
+      ptextunmap(pa);
+    else
+      kfree((void*)pa);
+    return 0;
+  }
+  return pa;
+}
+
+// Handle a fault on user address va in the current process,
+// if it lies in a VMA that allows the access, which is PTE_R,
+// PTE_W or PTE_X: map the page of the file, or let a shared
+// page be written. Returns the page's physical address, or 0
+// if va isn't mapped or the page can't be read in here.
+// Reading in sleeps and locks the file's inode, so it isn't
+// done under a spinlock, nor while holding any inode lock,
+// which could be taken in the other order by someone else;
+// callers that copy under an inode lock prefault first.
+uint64
+vmafault(pagetable_t pagetable, uint64 va, int access)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  struct inode *ip;
+  pte_t *pte;
+  uint64 pa;
+  uint off;
+  int perm;
+
+  if(p == 0 || pagetable != p->pagetable || va >= MAXVA)
+    return 0;
+  va = PGROUNDDOWN(va);
+  if(va < p->sz){
+    pte = walk(pagetable, va, 0);
+    if(pte && (*pte & PTE_SWAP)){
+      if((*pte & access) != access || holdingspin())
+        return 0;
+      return swapin(pagetable, va);
+    }
+    return segfault(p, va, access);
+  }
+  if((v = lookup(p, va)) == 0)
+    return 0;
+  if(access == PTE_X ? (v->prot & PROT_EXEC) == 0 :
+     access == PTE_W ? (v->prot & PROT_WRITE) == 0 :
+     (v->prot & (PROT_READ | PROT_WRITE)) == 0)
+    return 0;
+
+  pte = walk(pagetable, va, 0);
+  if(pte && (*pte & PTE_V)){
+    // first write to a shared page that was read in clean.
+    if(access == PTE_W && (*pte & PTE_W) == 0 && v->flags == MAP_SHARED){
+      pwritable(PTE2PA(*pte));
+      *pte |= PTE_W;
+    }
+    return PTE2PA(*pte);
+  }
+
+  ip = v->f->ip;
+  if(holdingspin() || p->nilock > 0)
+    return 0;
+  off = v->off + (va - v->addr);
+  if(v->flags == MAP_SHARED){
+    ilock(ip);
+    pa = pmap(ip, off / PGSIZE);
+    iunlock(ip);
+    if(pa == 0)
+      return 0;
+  } else {
+    if((pa = (uint64)kalloc_zero()) == 0)
+      return 0;
+    ilock(ip);
+    readi(ip, 0, pa, off, PGSIZE);
+    iunlock(ip);
+  }
+
+  perm = PTE_U;
+  if(v->prot & (PROT_READ | PROT_WRITE))
+    perm |= PTE_R;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  if((v->prot & PROT_WRITE) && (access == PTE_W || v->flags == MAP_PRIVATE))
+    perm |= PTE_W;
+  if(v->flags == MAP_SHARED && (perm & PTE_W))
+    pwritable(pa);
+  if(mappages(pagetable, va, PGSIZE, pa, perm) != 0){
+    if(v->flags == MAP_SHARED)
+      punmap(pa, (perm & PTE_W) != 0);
+    else
+      kfree((void*)pa);
+    return 0;
+  }
+  return pa;
+}
+
+// Make sure [va, va+n) of the current process is mapped, and
+// writable if write is set, reading in mmap()ed pages as
+// needed, so that a copy under a spinlock can't fault.
+int
+vmaprefault(uint64 va, uint64 n, int write)
+{
+  struct proc *p = myproc();
+  uint64 a;
+  pte_t *pte;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    if(a >= MAXVA)
+      return -1;
+    pte = walk(p->pagetable, a, 0);
+    if(pte && (*pte & PTE_V) && (*pte & PTE_U) && (!write || (*pte & PTE_W)))
+      continue;
+    if(vmafault(p->pagetable, a, write ? PTE_W : PTE_R) == 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Drop all of p's mappings.
+static void
+unmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->addr == 0)
+      continue;
+    unmaprange(p, v, v->addr, v->addr + v->len);
+    fileclose(v->f);
+    v->addr = 0;
+    v->f = 0;
+  }
+}
+
+// Give child np p's mappings: the same page cache pages for
+// shared regions, and copies of the pages p has read in for
+// private ones.
+int
+vmafork(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  uint64 a;
+  pte_t *pte;
+  char *mem;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    if(v->addr == 0)
+      continue;
+    np->vma[i] = *v;
+    np->vma[i].f = filedup(v->f);
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        continue;
+      if(v->flags == MAP_SHARED){
+        pmapdup(PTE2PA(*pte), (*pte & PTE_W) != 0);
+        if(mappages(np->pagetable, a, PGSIZE, PTE2PA(*pte), PTE_FLAGS(*pte)) != 0){
+          punmap(PTE2PA(*pte), (*pte & PTE_W) != 0);
+          goto bad;
+        }
+        continue;
+      }
+      if((mem = kalloc()) == 0)
+        goto bad;
+      memmove(mem, (char*)PTE2PA(*pte), PGSIZE);
+      if(mappages(np->pagetable, a, PGSIZE, (uint64)mem, PTE_FLAGS(*pte)) != 0){
+        kfree(mem);
+        goto bad;
+      }
+    }
+  }
+  return 0;
+
+ bad:
+  unmapall(np);
+  return -1;
+}
+
+// Unmap everything, for exit() and exec().
+void
+vmaexit(struct proc *p)
+{
+  unmapall(p);
+}
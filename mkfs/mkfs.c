@@ -19,6 +19,7 @@
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// followed by [ swap ], which the kernel initializes.
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
@@ -102,9 +103,11 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(FSSIZE);
+  sb.nswap = xint(NSWAP);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d swap %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE, NSWAP);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
@@ -172,6 +175,12 @@ main(int argc, char *argv[])
 
   balloc(freeblock);
 
+  // the swap area needn't be written, only exist.
+  if(ftruncate(fsfd, (off_t)(FSSIZE + NSWAP) * BSIZE) < 0){
+    perror("ftruncate");
+    exit(1);
+  }
+
   exit(0);
 }
 
@@ -0,0 +1,164 @@
+// iobench: time sequential and random block writes to files,
+// from several processes at once, each write forced to disk
+// with sync(), and show what the I/O scheduler made of them.
+// iobench -q instead writes the same amount of data from
+// 1, 2, 4 and 8 processes, to see how throughput follows the
+// number of requests the disk has queued.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define MAXCHILD 8
+#define NTOTAL 192 // blocks written, over all files
+#define SYNCN  4   // writes between syncs
+
+char data[BSIZE];
+char buf[512];
+
+static unsigned long rnd = 1;
+
+static int
+rand(void)
+{
+  rnd = rnd * 1103515245 + 12345;
+  return (rnd / 65536) % 32768;
+}
+
+static void
+fname(char *path, int i)
+{
+  strcpy(path, "iobench0");
+  path[7] = '0' + i;
+}
+
+// open path with its offset at block k, by reading up to it.
+static int
+openat(char *path, int k)
+{
+  int fd;
+
+  if((fd = open(path, O_RDWR)) < 0){
+    fprintf(2, "iobench: cannot open %s\n", path);
+    exit(1);
+  }
+  while(k-- > 0){
+    if(read(fd, data, BSIZE) != BSIZE){
+      fprintf(2, "iobench: short read\n");
+      exit(1);
+    }
+  }
+  return fd;
+}
+
+static void
+child(int i, int random, int nblk)
+{
+  char path[16];
+  int order[NTOTAL];
+  int j, k, t, fd;
+
+  fname(path, i);
+  for(j = 0; j < nblk; j++)
+    order[j] = j;
+  if(random){
+    rnd = i + 1;
+    for(j = nblk - 1; j > 0; j--){
+      k = rand() % (j + 1);
+      t = order[j];
+      order[j] = order[k];
+      order[k] = t;
+    }
+  }
+
+  memset(data, 'a' + i, sizeof(data));
+  fd = -1;
+  for(j = 0; j < nblk; j++){
+    if(fd < 0 || (j > 0 && order[j] != order[j-1] + 1)){
+      if(fd >= 0)
+        close(fd);
+      fd = openat(path, order[j]);
+      memset(data, 'a' + i, sizeof(data));
+    }
+    if(write(fd, data, BSIZE) != BSIZE){
+      fprintf(2, "iobench: write failed\n");
+      exit(1);
+    }
+    if(j % SYNCN == SYNCN - 1)
+      sync();
+  }
+  close(fd);
+  exit(0);
+}
+
+static void
+stats(void)
+{
+  int fd, n;
+
+  if((fd = open("/stats", O_RDONLY)) < 0)
+    return;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+}
+
+static void
+run(char *name, int random, int nchild)
+{
+  char path[16];
+  int i, fd, t0, t1;
+  int nblk = NTOTAL / nchild;
+
+  // create the files, untimed.
+  memset(data, 0, sizeof(data));
+  for(i = 0; i < nchild; i++){
+    fname(path, i);
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      fprintf(2, "iobench: cannot create %s\n", path);
+      exit(1);
+    }
+    for(int j = 0; j < nblk; j++)
+      write(fd, data, BSIZE);
+    close(fd);
+  }
+  sync();
+
+  t0 = uptime();
+  for(i = 0; i < nchild; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "iobench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      child(i, random, nblk);
+  }
+  for(i = 0; i < nchild; i++)
+    wait(0);
+  t1 = uptime();
+
+  printf("%s: %d procs x %d blocks in %d ticks\n", name, nchild, nblk, t1 - t0);
+  stats();
+
+  for(i = 0; i < nchild; i++){
+    fname(path, i);
+    unlink(path);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1 && strcmp(argv[1], "-q") == 0){
+    for(int n = 1; n <= MAXCHILD; n *= 2)
+      run("depth", 0, n);
+    exit(0);
+  }
+  run("sequential", 0, NCHILD);
+  run("random", 1, NCHILD);
+  exit(0);
+}
@@ -0,0 +1,155 @@
+// kmembench: time kernel paths that touch a lot of memory,
+// to compare kernels built with and without superpages for
+// the kernel's direct map (make SUPERPAGE=0): copyout() from
+// the page cache, memmove() out of the buffer cache, and
+// copies through a large pipe. bench/superpage runs it on
+// both kernels and tabulates the results.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define FILESZ (256*1024)  // fits in MAXFILE blocks
+#define NREAD  64          // reads of the whole file
+#define NLINK  60          // entries in the test directory
+#define NDIR   2000        // reads of the whole directory
+#define PIPETOTAL (8*1024*1024)
+
+char buf[MAXPIPE];
+
+// copyout() from page cache pages spread over physical memory.
+static void
+filerun(void)
+{
+  int fd, i, n, t0, t1;
+
+  if((fd = open("kmembench", O_CREATE | O_RDWR)) < 0){
+    fprintf(2, "kmembench: cannot create kmembench\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < FILESZ; i += sizeof(buf)){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "kmembench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < NREAD; i++){
+    fd = open("kmembench", O_RDONLY);
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      ;
+    close(fd);
+  }
+  t1 = uptime();
+  printf("file: %d reads of %d bytes in %d ticks\n", NREAD, FILESZ, t1 - t0);
+  unlink("kmembench");
+}
+
+// memmove() out of buffer cache blocks, then copyout().
+static void
+dirrun(void)
+{
+  char name[16];
+  int fd, i, t0, t1;
+
+  if(mkdir("kmembenchd") < 0 || (fd = open("kmembenchd/f", O_CREATE | O_RDWR)) < 0){
+    fprintf(2, "kmembench: cannot create kmembenchd\n");
+    exit(1);
+  }
+  close(fd);
+  strcpy(name, "kmembenchd/l00");
+  for(i = 0; i < NLINK; i++){
+    name[12] = '0' + i / 10;
+    name[13] = '0' + i % 10;
+    if(link("kmembenchd/f", name) < 0){
+      fprintf(2, "kmembench: link failed\n");
+      exit(1);
+    }
+  }
+
+  t0 = uptime();
+  for(i = 0; i < NDIR; i++){
+    fd = open("kmembenchd", O_RDONLY);
+    while(read(fd, buf, sizeof(struct dirent) * 8) > 0)
+      ;
+    close(fd);
+  }
+  t1 = uptime();
+  printf("dir: %d reads of %d entries in %d ticks\n", NDIR, NLINK + 3, t1 - t0);
+
+  for(i = 0; i < NLINK; i++){
+    name[12] = '0' + i / 10;
+    name[13] = '0' + i % 10;
+    unlink(name);
+  }
+  unlink("kmembenchd/f");
+  unlink("kmembenchd");
+}
+
+// copyin() and copyout() through a ring of MAXPIPE bytes.
+static void
+piperun(void)
+{
+  int fds[2], pid, n, total, t0, t1;
+
+  if(pipe(fds) < 0 || fcntl(fds[1], F_SETPIPE_SZ, MAXPIPE) < 0){
+    fprintf(2, "kmembench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "kmembench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(total = 0; total < PIPETOTAL; total += sizeof(buf))
+      write(fds[1], buf, sizeof(buf));
+    exit(0);
+  }
+  close(fds[1]);
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    ;
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+  printf("pipe: %d bytes in %d ticks\n", PIPETOTAL, t1 - t0);
+}
+
+// print the kernel page table's line of /stats.
+static void
+kvmline(void)
+{
+  int fd, n, i, start;
+
+  if((fd = open("/stats", O_RDONLY)) < 0)
+    return;
+  n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if(n <= 0)
+    return;
+  buf[n] = 0;
+  for(start = 0; start < n; start = i + 1){
+    for(i = start; i < n && buf[i] != '\n'; i++)
+      ;
+    if(memcmp(buf + start, "kvm:", 4) == 0)
+      write(1, buf + start, i - start + 1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  kvmline();
+  filerun();
+  dirrun();
+  piperun();
+  exit(0);
+}
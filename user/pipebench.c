@@ -0,0 +1,70 @@
+// pipebench: time pushing data through a pipe from one
+// process to another, for a range of pipe sizes and
+// write sizes.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define TOTAL (4*1024*1024)  // bytes per run
+
+char buf[MAXPIPE];
+
+static void
+run(int pipesz, int wsz)
+{
+  int fds[2], pid, n, total, t0, t1, sz;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+  if((sz = fcntl(fds[1], F_SETPIPE_SZ, pipesz)) < 0){
+    fprintf(2, "pipebench: cannot set pipe size %d\n", pipesz);
+    exit(1);
+  }
+
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(total = 0; total < TOTAL; total += wsz){
+      if(write(fds[1], buf, wsz) != wsz){
+        fprintf(2, "pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  close(fds[1]);
+  total = 0;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    total += n;
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+
+  if(total != TOTAL){
+    fprintf(2, "pipebench: read %d bytes, wanted %d\n", total, TOTAL);
+    exit(1);
+  }
+  printf("pipe %d, writes of %d: %d ticks\n", sz, wsz, t1 - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pipesz, wsz;
+
+  for(pipesz = 4096; pipesz <= MAXPIPE; pipesz *= 4)
+    for(wsz = 512; wsz <= MAXPIPE; wsz *= 8)
+      run(pipesz, wsz);
+  exit(0);
+}
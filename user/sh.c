@@ -52,6 +52,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 
 // Execute cmd.  Never returns.
 void
@@ -130,6 +131,84 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Can cmd be started with spawn(), without a forked shell?
+// Yes if it's a command with redirections of 0 and 1, or a
+// pipeline of them, which is what most lines are.
+int
+spawnable(struct cmd *cmd)
+{
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    return rcmd->fd <= 2 && spawnable(rcmd->cmd);
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    return spawnable(pcmd->left) && spawnable(pcmd->right);
+  }
+  return 0;
+}
+
+// Start the processes of spawnable cmd, with fd[0], fd[1]
+// and fd[2] as their descriptors 0, 1 and 2. Returns the
+// number started, for the caller to wait for.
+int
+spawncmd(struct cmd *cmd, int *fd)
+{
+  int p[2], f[3], rfd, n;
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      return 0;
+    if(spawn(ecmd->argv[0], ecmd->argv, fd) < 0){
+      fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if((rfd = open(rcmd->file, rcmd->mode)) < 0){
+      fprintf(2, "open %s failed\n", rcmd->file);
+      return 0;
+    }
+    memmove(f, fd, sizeof(f));
+    f[rcmd->fd] = rfd;
+    n = spawncmd(rcmd->cmd, f);
+    close(rfd);
+    return n;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0){
+      fprintf(2, "pipe failed\n");
+      return 0;
+    }
+    memmove(f, fd, sizeof(f));
+    f[1] = p[1];
+    n = spawncmd(pcmd->left, f);
+    memmove(f, fd, sizeof(f));
+    f[0] = p[0];
+    n += spawncmd(pcmd->right, f);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+  panic("spawncmd");
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,7 +224,9 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  int fd, n;
+  int stdfd[3] = { 0, 1, 2 };
+  struct cmd *cmd;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,9 +245,18 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    if(spawnable(cmd)){
+      // no need to copy the shell just to replace the copy.
+      for(n = spawncmd(cmd, stdfd); n > 0; n--)
+        wait(0);
+    } else {
+      if(fork1() == 0)
+        runcmd(cmd);
+      wait(0);
+    }
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -324,18 +414,36 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// The shell parses commands itself, so a syntax error is
+// reported, and the command dropped, rather than a panic.
+int parsefailed;
+
+void
+syntaxerror(char *s)
+{
+  if(!parsefailed)
+    fprintf(2, "%s\n", s);
+  parsefailed = 1;
+}
+
+// Parse command line s. Returns 0 if it has a syntax error.
 struct cmd*
 parsecmd(char *s)
 {
   char *es;
   struct cmd *cmd;
 
+  parsefailed = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parsefailed){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntaxerror("syntax");
+  }
+  if(parsefailed){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +487,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntaxerror("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +515,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntaxerror("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +543,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntaxerror("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntaxerror("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +607,40 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
@@ -0,0 +1,80 @@
+// spawnbench: how fast can a process start another program
+// and wait for it? Compares fork() then exec(), vfork() then
+// exec(), and spawn(), first from a small process, then after
+// growing this one, which fork() has to copy.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NSPAWN 200
+#define BIGHEAP (4*1024*1024)
+
+// echo, with its output closed, is about the least a child
+// can do.
+char *echoargv[] = { "echo", "spawnbench", 0 };
+
+static void
+forkrun(int (*forkfn)(void))
+{
+  int pid;
+
+  pid = forkfn();
+  if(pid < 0){
+    fprintf(2, "spawnbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    exec(echoargv[0], echoargv);
+    exit(1);
+  }
+  wait(0);
+}
+
+static void
+spawnrun(void)
+{
+  int fd[3] = { 0, -1, 2 };
+
+  if(spawn(echoargv[0], echoargv, fd) < 0){
+    fprintf(2, "spawnbench: spawn failed\n");
+    exit(1);
+  }
+  wait(0);
+}
+
+static void
+run(char *what)
+{
+  int i, t0, t1, t2, t3;
+
+  t0 = uptime();
+  for(i = 0; i < NSPAWN; i++)
+    forkrun(fork);
+  t1 = uptime();
+  for(i = 0; i < NSPAWN; i++)
+    forkrun(vfork);
+  t2 = uptime();
+  for(i = 0; i < NSPAWN; i++)
+    spawnrun();
+  t3 = uptime();
+  printf("%s: %d runs: fork+exec %d ticks, vfork+exec %d ticks, spawn %d ticks\n",
+         what, NSPAWN, t1 - t0, t2 - t1, t3 - t2);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *p;
+
+  run("small");
+
+  if((p = sbrk(BIGHEAP)) == (char*)-1){
+    fprintf(2, "spawnbench: sbrk failed\n");
+    exit(1);
+  }
+  memset(p, 1, BIGHEAP);
+  run("4MB heap");
+  exit(0);
+}
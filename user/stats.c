@@ -0,0 +1,46 @@
+// stats: print the kernel's counters, from the statistics device.
+// stats diskmode intr|poll|hybrid: switch the disk driver's
+// completion mode.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char buf[512];
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n;
+
+  if(argc == 3){
+    if(strlen(argv[1]) + strlen(argv[2]) + 2 > sizeof(buf)){
+      fprintf(2, "stats: command too long\n");
+      exit(1);
+    }
+    if((fd = open("/stats", O_WRONLY)) < 0){
+      fprintf(2, "stats: cannot open /stats\n");
+      exit(1);
+    }
+    n = strlen(argv[1]);
+    memmove(buf, argv[1], n);
+    buf[n++] = ' ';
+    strcpy(buf + n, argv[2]);
+    if(write(fd, buf, strlen(buf)) < 0){
+      fprintf(2, "stats: %s %s failed\n", argv[1], argv[2]);
+      exit(1);
+    }
+    close(fd);
+    exit(0);
+  }
+
+  if((fd = open("/stats", O_RDONLY)) < 0){
+    fprintf(2, "stats: cannot open /stats\n");
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+  exit(0);
+}
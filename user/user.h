@@ -1,5 +1,6 @@
 struct stat;
 struct rtcdate;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -23,6 +24,19 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int sync(void);
+int fcntl(int, int, int);
+int splice(int, int, int);
+int tee(int, int, int);
+int sendfile(int, int, uint*, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+int readv(int, struct iovec*, int);
+int writev(int, const struct iovec*, int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int vfork(void);
+int spawn(char*, char**, int*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -4,6 +4,7 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -680,6 +681,557 @@ exectest(char *s)
 
 }
 
+int vforkshared;
+
+// spawn() starts a program with just the descriptors it's
+// given, and vfork()'s child runs in its parent's memory until
+// it calls exec() or exit().
+void
+spawntest(char *s)
+{
+  int fds[2], fd[3], pid, xstatus;
+  char *echoargv[] = { "echo", "OK", 0 };
+  char buf[4];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fd[0] = -1;
+  fd[1] = fds[1];
+  fd[2] = 2;
+  if((pid = spawn("echo", echoargv, fd)) < 0){
+    printf("%s: spawn echo failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  if(read(fds[0], buf, sizeof(buf)) != 3 || buf[0] != 'O' || buf[1] != 'K'){
+    printf("%s: wrong output from spawned echo\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait for spawned echo failed\n", s);
+    exit(1);
+  }
+  if(spawn("nonexistent", echoargv, 0) >= 0){
+    printf("%s: spawn nonexistent succeeded\n", s);
+    exit(1);
+  }
+
+  vforkshared = 0;
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    vforkshared = 1;
+    exit(7);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7 || vforkshared != 1){
+    printf("%s: vfork child didn't share memory\n", s);
+    exit(1);
+  }
+
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    exec("echo", echoargv);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: vfork then exec failed\n", s);
+    exit(1);
+  }
+}
+
+// resizing a pipe keeps its data, and lets a writer put
+// more in without blocking.
+void
+pipesize(char *s)
+{
+  int fds[2], i, n, seq, total;
+  enum { N1=1000, N2=8000, BIG=16384 };
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) < 512){
+    printf("%s: F_GETPIPE_SZ failed\n", s);
+    exit(1);
+  }
+  seq = 0;
+  for(i = 0; i < N1; i++)
+    buf[i] = seq++;
+  if(write(fds[1], buf, N1) != N1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, BIG) != BIG ||
+     fcntl(fds[0], F_GETPIPE_SZ, 0) != BIG){
+    printf("%s: F_SETPIPE_SZ failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N2; i++)
+    buf[i] = seq++;
+  if(write(fds[1], buf, N2) != N2){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) >= 0){
+    printf("%s: shrank a pipe below its contents\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+
+  seq = 0;
+  total = 0;
+  while((n = read(fds[0], buf, 3000)) > 0){
+    for(i = 0; i < n; i++){
+      if((buf[i] & 0xff) != (seq++ & 0xff)){
+        printf("%s: wrong data\n", s);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  if(total != N1 + N2){
+    printf("%s: read %d bytes, wanted %d\n", s, total, N1 + N2);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
+// splice() a file into a pipe, tee() that into another
+// pipe, and splice() both out again.
+void
+splicetest(char *s)
+{
+  int fd, fd2, p1[2], p2[2], i, n;
+  enum { N=3000 };
+
+  unlink("splicein");
+  unlink("spliceout");
+  fd = open("splicein", O_CREATE|O_RDWR);
+  fd2 = open("spliceout", O_CREATE|O_RDWR);
+  if(fd < 0 || fd2 < 0){
+    printf("%s: cannot create files\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    buf[i] = i * 7;
+  if(write(fd, buf, N) != N){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(splice(fd2, fd2, 10) >= 0){
+    printf("%s: spliced between two files\n", s);
+    exit(1);
+  }
+  if(pipe(p1) < 0 || pipe(p2) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  fd = open("splicein", O_RDONLY);
+  for(i = 0; i < N; i += n){
+    if((n = splice(fd, p1[1], N - i)) <= 0){
+      printf("%s: splice into pipe failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  close(p1[1]);
+  for(i = 0; i < N; i += n){
+    if((n = tee(p1[0], p2[1], N - i)) <= 0){
+      printf("%s: tee failed\n", s);
+      exit(1);
+    }
+  }
+  close(p2[1]);
+  if(tee(p1[0], p2[1], 1) >= 0){
+    printf("%s: tee into closed fd\n", s);
+    exit(1);
+  }
+  while((n = splice(p1[0], fd2, N)) > 0)
+    ;
+  close(p1[0]);
+  close(fd2);
+
+  memset(buf, 0, N);
+  if(read(p2[0], buf, N) != N){
+    printf("%s: short read from tee'd pipe\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i * 7)){
+      printf("%s: wrong data from tee\n", s);
+      exit(1);
+    }
+  }
+  close(p2[0]);
+
+  fd2 = open("spliceout", O_RDONLY);
+  memset(buf, 0, N);
+  if(read(fd2, buf, N+1) != N){
+    printf("%s: spliceout has wrong size\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i * 7)){
+      printf("%s: wrong data from splice\n", s);
+      exit(1);
+    }
+  }
+  close(fd2);
+  unlink("splicein");
+  unlink("spliceout");
+}
+
+// sendfile() from an explicit offset into a pipe, and from
+// the file offset into another file.
+void
+sendfiletest(char *s)
+{
+  int fd, fd2, fds[2], i, n;
+  uint off;
+  enum { N=5000, OFF=1000 };
+
+  unlink("sendin");
+  unlink("sendout");
+  fd = open("sendin", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create sendin\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    buf[i] = i * 3;
+  if(write(fd, buf, N) != N){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("sendin", O_RDONLY);
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  off = OFF;
+  if((n = sendfile(fds[1], fd, &off, 2000)) != 2000 || off != OFF + 2000){
+    printf("%s: sendfile to pipe returned %d, off %d\n", s, n, off);
+    exit(1);
+  }
+  close(fds[1]);
+  memset(buf, 0, N);
+  if(read(fds[0], buf, N) != 2000){
+    printf("%s: short read from pipe\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2000; i++){
+    if(buf[i] != (char)((OFF + i) * 3)){
+      printf("%s: wrong data in pipe\n", s);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+
+  // the file offset hasn't moved, so this sends everything.
+  fd2 = open("sendout", O_CREATE|O_RDWR);
+  if((n = sendfile(fd2, fd, 0, N + 100)) != N){
+    printf("%s: sendfile to file returned %d\n", s, n);
+    exit(1);
+  }
+  if(sendfile(fd2, fd, 0, 10) != 0){
+    printf("%s: sendfile past end\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+  fd2 = open("sendout", O_RDONLY);
+  memset(buf, 0, N);
+  if(read(fd2, buf, N+1) != N){
+    printf("%s: sendout has wrong size\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i * 3)){
+      printf("%s: wrong data in sendout\n", s);
+      exit(1);
+    }
+  }
+  close(fd2);
+  unlink("sendin");
+  unlink("sendout");
+}
+
+// writev() a vector of small and large buffers, check it
+// with pread(), patch it with pwrite(), and readv() it back.
+void
+preadv(char *s)
+{
+  int fd, i, n;
+  struct iovec iov[3];
+  char small[10], tail[150];
+  enum { BIG=4000, N=BIG+110 };  // 10 + BIG + 100
+
+  unlink("preadv");
+  fd = open("preadv", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create preadv\n", s);
+    exit(1);
+  }
+  memset(small, 'a', sizeof(small));
+  for(i = 0; i < BIG; i++)
+    buf[i] = i;
+  memset(tail, 'z', 100);
+  iov[0].iov_base = small;
+  iov[0].iov_len = sizeof(small);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = BIG;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = 100;
+  if((n = writev(fd, iov, 3)) != N){
+    printf("%s: writev returned %d\n", s, n);
+    exit(1);
+  }
+
+  // pread and pwrite leave the file offset at N.
+  if(pread(fd, small, 4, 12) != 4 || small[0] != 2 || small[3] != 5){
+    printf("%s: pread got wrong data\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "xyz", 3, 0) != 3){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(read(fd, small, 1) != 0){
+    printf("%s: offset moved\n", s);
+    exit(1);
+  }
+  if(pread(fd, small, 1, N) != 0){
+    printf("%s: pread past end\n", s);
+    exit(1);
+  }
+
+  // a length no file could take is refused, not looped on.
+  iov[0].iov_base = small;
+  iov[0].iov_len = 1UL << 32;
+  if(writev(fd, iov, 1) != -1 || readv(fd, iov, 1) != -1){
+    printf("%s: huge iov_len accepted\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("preadv", O_RDONLY);
+  memset(buf, 0, BIG);
+  iov[0].iov_base = small;
+  iov[0].iov_len = sizeof(small);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = BIG;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof(tail);  // more than is left
+  if((n = readv(fd, iov, 3)) != N){
+    printf("%s: readv returned %d\n", s, n);
+    exit(1);
+  }
+  if(small[0] != 'x' || small[2] != 'z' || small[3] != 'a' || buf[BIG-1] != (char)(BIG-1) || tail[99] != 'z'){
+    printf("%s: readv got wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("preadv");
+}
+
+// mmap: lazy loading, MAP_PRIVATE and MAP_SHARED, writeback
+// on munmap and exit, inheritance across fork, and mapped
+// pages used as read/write buffers.
+void
+mmaptest(char *s)
+{
+  enum { N=2*PGSIZE+PGSIZE/2 };
+  int fd, i, n, pid, xstatus, fds[2];
+  char *p, c;
+
+  unlink("mmap");
+  fd = open("mmap", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create mmap\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    c = 'A' + i % 23;
+    if(write(fd, &c, 1) != 1){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // private: the file's data, zeroes past its end, and
+  // writes that don't reach the file.
+  fd = open("mmap", O_RDONLY);
+  if(mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (char*)-1){
+    printf("%s: writable shared map of read-only file\n", s);
+    exit(1);
+  }
+  p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3*PGSIZE; i++){
+    if(p[i] != (i < N ? 'A' + i % 23 : 0)){
+      printf("%s: wrong byte %d in mapping\n", s, i);
+      exit(1);
+    }
+  }
+  p[0] = '!';
+  // punch out the middle page; the others stay.
+  if(munmap(p + PGSIZE, PGSIZE) < 0 || p[2*PGSIZE] != 'A' + (2*PGSIZE) % 23 || p[0] != '!'){
+    printf("%s: partial munmap\n", s);
+    exit(1);
+  }
+  if(munmap(p, 3*PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(read(fd, &c, 1) != 1 || c != 'A'){
+    printf("%s: private write reached the file\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // shared.
+  fd = open("mmap", O_RDWR);
+  p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == (char*)-1){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  p[1] = '#';
+  // pipe data from and to pages not yet read in.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], p + PGSIZE + 10, 10) != 10 ||
+     read(fds[0], p + 2*PGSIZE + 100, 10) != 10){
+    printf("%s: pipe to or from mapping failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(p[1] != '#')
+      exit(1);
+    p[PGSIZE] = '$';
+    exit(0);  // without munmap
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || p[PGSIZE] != '$'){
+    printf("%s: mapping not shared with child\n", s);
+    exit(1);
+  }
+  if(munmap(p, N) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  fd = open("mmap", O_RDONLY);
+  for(i = 0; (n = read(fd, &c, 1)) == 1; i++){
+    char want = 'A' + i % 23;
+    if(i == 1)
+      want = '#';
+    else if(i == PGSIZE)
+      want = '$';
+    else if(i >= 2*PGSIZE + 100 && i < 2*PGSIZE + 110)
+      want = 'A' + (i - PGSIZE - 90) % 23;
+    if(c != want){
+      printf("%s: file byte %d is %x, not %x\n", s, i, c, want);
+      exit(1);
+    }
+  }
+  if(i != N){
+    printf("%s: file is %d bytes, not %d\n", s, i, N);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmap");
+}
+
+// read() and write() with buffers in mappings not read in
+// yet, even of the same file, and executing a mapping
+// without PROT_EXEC.
+void
+mmapio(char *s)
+{
+  int fd, fd2, pid, xstatus;
+  char *p, buf[16];
+
+  unlink("mmapio");
+  fd = open("mmapio", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "0123456789abcdef", 16) != 16){
+    printf("%s: cannot create mmapio\n", s);
+    exit(1);
+  }
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  // into its own file's mapping.
+  if(pread(fd, p + 8, 4, 0) != 4 || memcmp(p, "012345670123", 12) != 0){
+    printf("%s: read into own mapping failed\n", s);
+    exit(1);
+  }
+  munmap(p, PGSIZE);
+
+  // from the mapping to another file.
+  p = mmap(0, PGSIZE, PROT_READ, MAP_SHARED, fd, 0);
+  unlink("mmapio2");
+  fd2 = open("mmapio2", O_CREATE|O_RDWR);
+  if(p == (char*)-1 || fd2 < 0 || write(fd2, p, 16) != 16 ||
+     pread(fd2, buf, 16, 0) != 16 || memcmp(buf, "012345670123cdef", 16) != 0){
+    printf("%s: write from mapping failed\n", s);
+    exit(1);
+  }
+  close(fd2);
+  unlink("mmapio2");
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    ((void (*)(void))p)();
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: executed a mapping without PROT_EXEC\n", s);
+    exit(1);
+  }
+  munmap(p, PGSIZE);
+  close(fd);
+  unlink("mmapio");
+}
+
 // simple fork and pipe read/write
 
 void
@@ -1658,6 +2210,197 @@ subdir(char *s)
   }
 }
 
+// The line of a fresh /stats snapshot that starts with
+// name, up to its newline, or 0.
+char*
+statline(char *name)
+{
+  static char sb[2048];
+  int fd, n, i;
+
+  if((fd = open("/stats", O_RDONLY)) < 0)
+    return 0;
+  // finish off any snapshot an earlier reader left, which
+  // may be older than the caller wants.
+  while(read(fd, sb, sizeof(sb)) > 0)
+    ;
+  n = read(fd, sb, sizeof(sb) - 1);
+  close(fd);
+  if(n <= 0)
+    return 0;
+  sb[n] = 0;
+  for(i = 0; i < n; i++){
+    if(i > 0 && sb[i-1] != '\n')
+      continue;
+    if(memcmp(sb + i, name, strlen(name)) == 0)
+      return sb + i;
+  }
+  return 0;
+}
+
+// The number just before word on the line of /stats that
+// starts with name, or -1.
+int
+statcount(char *name, char *word)
+{
+  char *l;
+  int j, v, len;
+
+  if((l = statline(name)) == 0)
+    return -1;
+  len = strlen(word);
+  for(j = 0; l[j] && l[j] != '\n'; j++){
+    if(l[j] != ' ' || memcmp(l + j + 1, word, len) != 0)
+      continue;
+    while(j > 0 && l[j-1] >= '0' && l[j-1] <= '9')
+      j--;
+    for(v = 0; l[j] >= '0' && l[j] <= '9'; j++)
+      v = v*10 + l[j] - '0';
+    return v;
+  }
+  return -1;
+}
+
+// Switch the disk driver's completion mode through /stats.
+int
+diskmode(char *mode)
+{
+  char cmd[32];
+  int fd, n;
+
+  if((fd = open("/stats", O_WRONLY)) < 0)
+    return -1;
+  strcpy(cmd, "diskmode ");
+  strcpy(cmd + 9, mode);
+  n = write(fd, cmd, strlen(cmd));
+  close(fd);
+  return n == strlen(cmd) ? 0 : -1;
+}
+
+// switch the disk between interrupt, polled and hybrid
+// completions with I/O going on, and check that each mode's
+// requests are counted in its own histogram.
+void
+diskmodes(char *s)
+{
+  static char *modes[] = { "poll", "intr", "hybrid", "poll", "hybrid" };
+  char name[16], orig[16], b[BSIZE], *l;
+  int fd, i, j, pid, before, xstatus;
+
+  if((l = statline("disk: mode ")) == 0)
+    return;  // a RAM disk
+  for(i = 0; i < sizeof(orig) - 1 && l[11+i] != ',' && l[11+i] != '\n'; i++)
+    orig[i] = l[11+i];
+  orig[i] = 0;
+  if(diskmode("fast") == 0){
+    printf("%s: accepted an unknown mode\n", s);
+    exit(1);
+  }
+
+  // a writer keeps requests in flight across the switches.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    fd = open("diskmodes", O_CREATE|O_RDWR);
+    for(i = 0; i < 40; i++){
+      memset(b, i, sizeof(b));
+      if(pwrite(fd, b, sizeof(b), (i % 8) * BSIZE) != sizeof(b) || sync() != 0)
+        exit(1);
+    }
+    exit(0);
+  }
+
+  for(i = 0; i < sizeof(modes)/sizeof(modes[0]); i++){
+    strcpy(name, "disk ");
+    strcpy(name + 5, modes[i]);
+    strcpy(name + strlen(name), ":");
+    before = statcount(name, "reqs");
+    if(diskmode(modes[i]) < 0){
+      printf("%s: cannot switch to %s\n", s, modes[i]);
+      exit(1);
+    }
+    for(j = 0; j < 3; j++)
+      if(sync() != 0)
+        exit(1);
+    fd = open("diskmodes2", O_CREATE|O_RDWR);
+    if(fd < 0 || write(fd, b, sizeof(b)) != sizeof(b) || sync() != 0){
+      printf("%s: i/o in %s mode failed\n", s, modes[i]);
+      exit(1);
+    }
+    close(fd);
+    unlink("diskmodes2");
+    sync();
+    if(statcount(name, "reqs") <= (before < 0 ? 0 : before)){
+      printf("%s: no requests counted in %s mode\n", s, modes[i]);
+      exit(1);
+    }
+  }
+  wait(&xstatus);
+  diskmode(orig);
+  unlink("diskmodes");
+  if(xstatus != 0){
+    printf("%s: writer failed across mode switches\n", s);
+    exit(1);
+  }
+}
+
+// sync() between writes to a file must not lose or
+// reorder any of them, and once it returns nothing may be
+// left only in memory: no dirty buffers or file pages, and
+// no committed transaction not yet written home.
+void
+synctest(char *s)
+{
+  int fd, i, n;
+  char b[BSIZE];
+
+  unlink("syncfile");
+  fd = open("syncfile", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create syncfile\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    memset(b, 'a' + i, sizeof(b));
+    if(write(fd, b, sizeof(b)) != sizeof(b)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+    if(i % 3 == 0 && sync() != 0){
+      printf("%s: sync failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(sync() != 0){
+    printf("%s: sync failed\n", s);
+    exit(1);
+  }
+  if(statcount("bcache:", "dirty") != 0 || statcount("pcache:", "dirty") != 0 ||
+     statcount("log:", "committed") != 0){
+    printf("%s: sync left data in memory\n", s);
+    exit(1);
+  }
+
+  fd = open("syncfile", O_RDONLY);
+  if(fd < 0){
+    printf("%s: cannot open syncfile\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    n = read(fd, b, sizeof(b));
+    if(n != sizeof(b) || b[0] != 'a' + i || b[BSIZE-1] != 'a' + i){
+      printf("%s: read wrong data at block %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("syncfile");
+}
+
 // test writes that are larger than the log.
 void
 bigwrite(char *s)
@@ -1875,6 +2618,73 @@ dirfile(char *s)
   close(fd);
 }
 
+// more files open, and i-nodes in use, across the system
+// than fixed tables of 100 files and 50 i-nodes would hold.
+void
+manyopen(char *s)
+{
+  enum { NCHILD=12, NOPEN=10 };
+  int ready[2], go[2], i, j, pid, xstatus;
+  char name[8], c;
+
+  if(pipe(ready) < 0 || pipe(go) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(go[1]);
+      name[0] = 'm';
+      name[1] = 'o';
+      name[2] = 'a' + i;
+      name[4] = 0;
+      for(j = 0; j < NOPEN; j++){
+        name[3] = 'a' + j;
+        if(open(name, O_CREATE|O_RDWR) < 0){
+          write(ready[1], "n", 1);
+          exit(1);
+        }
+      }
+      // hold them all open until every child has.
+      write(ready[1], "x", 1);
+      read(go[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+  for(i = 0; i < NCHILD; i++){
+    if(read(ready[0], &c, 1) != 1)
+      break;
+  }
+  close(go[1]);
+  close(ready[0]);
+  for(j = 0; j < NCHILD; j++){
+    wait(&xstatus);
+    if(xstatus != 0 || i != NCHILD){
+      printf("%s: child could not open its files\n", s);
+      exit(1);
+    }
+  }
+
+  name[0] = 'm';
+  name[1] = 'o';
+  name[4] = 0;
+  for(i = 0; i < NCHILD; i++){
+    name[2] = 'a' + i;
+    for(j = 0; j < NOPEN; j++){
+      name[3] = 'a' + j;
+      unlink(name);
+    }
+  }
+}
+
 // test that iput() is called at the end of _namei().
 // also tests empty file names.
 void
@@ -2076,6 +2886,82 @@ sbrkmuch(char *s)
   }
 }
 
+// grow by whole aligned 2MB regions, which get megapages:
+// their data across fork, kernel copies to and from the
+// middle of one, and shrinking to partway into one.
+void
+sbrkhuge(char *s)
+{
+  enum { HUGE=2*1024*1024 };
+  char *oldbrk, *a, *p;
+  int fds[2], pid, xstatus;
+  uint64 i;
+
+  oldbrk = sbrk(0);
+  a = sbrk(HUGE - (uint64)oldbrk % HUGE + 2*HUGE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  p = a + HUGE - (uint64)a % HUGE;
+  for(i = 0; i < 2*HUGE; i += PGSIZE)
+    p[i] = i / PGSIZE;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < 2*HUGE; i += PGSIZE)
+      if(p[i] != (char)(i / PGSIZE))
+        exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  memcpy(p + HUGE + 3*PGSIZE - 2, "wxyz", 4);
+  if(write(fds[1], p + HUGE + 3*PGSIZE - 2, 4) != 4 ||
+     read(fds[0], p + 5*PGSIZE - 1, 4) != 4 ||
+     memcmp(p + 5*PGSIZE - 1, "wxyz", 4) != 0){
+    printf("%s: pipe to or from megapage failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  p[5*PGSIZE] = 5;
+
+  // split the first megapage; its lower half stays.
+  if(sbrk(-(HUGE + HUGE/2)) == (char*)0xffffffffffffffffL || sbrk(0) != p + HUGE/2){
+    printf("%s: sbrk could not shrink\n", s);
+    exit(1);
+  }
+  for(i = 0; i < HUGE/2; i += PGSIZE){
+    if(p[i] != (char)(i / PGSIZE)){
+      printf("%s: wrong data after shrinking\n", s);
+      exit(1);
+    }
+  }
+  if(sbrk(PGSIZE) != p + HUGE/2 || p[HUGE/2] != 0){
+    printf("%s: re-grown page not zeroed\n", s);
+    exit(1);
+  }
+
+  a = sbrk(0);
+  if(sbrk(-(sbrk(0) - oldbrk)) != a){
+    printf("%s: sbrk downsize failed\n", s);
+    exit(1);
+  }
+}
+
 // can we read the kernel's memory?
 void
 kernmem(char *s)
@@ -2364,6 +3250,68 @@ stacktest(char *s)
     exit(xstatus);
 }
 
+// program text is mapped read-only, shared with every other
+// process running the program, so writing it must trap, and
+// read() into it must not succeed.
+void
+textwrite(char *s)
+{
+  int pid, fd;
+  int xstatus;
+
+  fd = open("README", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open README failed\n", s);
+    exit(1);
+  }
+  if(read(fd, (void*)textwrite, 8) > 0){
+    printf("%s: read into text succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  pid = fork();
+  if(pid == 0) {
+    volatile int *addr = (int *) textwrite;
+    *addr = 10;
+    printf("%s: textwrite: wrote to text\n", s);
+    exit(1);
+  } else if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus == -1)  // kernel killed child?
+    exit(0);
+  else
+    exit(xstatus);
+}
+
+// a running program is paged in from its file as it runs,
+// so the file can't be opened for writing meanwhile.
+void
+textbusy(char *s)
+{
+  int fd;
+
+  fd = open("usertests", O_RDWR);
+  if(fd >= 0){
+    printf("%s: opened running program for writing\n", s);
+    exit(1);
+  }
+  fd = open("usertests", O_RDONLY|O_TRUNC);
+  if(fd >= 0){
+    printf("%s: truncated running program\n", s);
+    exit(1);
+  }
+  fd = open("echo", O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot open echo for writing\n", s);
+    exit(1);
+  }
+  close(fd);
+}
+
 // regression test. copyin(), copyout(), and copyinstr() used to cast
 // the virtual page address to uint, which (with certain wild system
 // call arguments) resulted in a kernel page faults.
@@ -2379,6 +3327,116 @@ pgbug(char *s)
   exit(0);
 }
 
+// grow past the size of RAM a page at a time, so without
+// megapages, and check that pages swapped out come back
+// intact, by faults and by system calls under a lock.
+void
+swaptest(char *s)
+{
+  enum { EXTRA=8*1024*1024 };
+  uint64 i, n;
+  char *a, *p;
+  int fds[2];
+
+  a = sbrk(0);
+  n = PHYSTOP - KERNBASE + EXTRA;
+  for(i = 0; i < n; i += PGSIZE){
+    if((p = sbrk(PGSIZE)) == (char*)0xffffffffffffffffL){
+      printf("%s: sbrk failed at %d pages\n", s, (int)(i / PGSIZE));
+      exit(1);
+    }
+    *(uint64*)p = i;
+  }
+  for(i = 0; i < n; i += PGSIZE){
+    if(*(uint64*)(a + i) != i){
+      printf("%s: wrong data in page %d\n", s, (int)(i / PGSIZE));
+      exit(1);
+    }
+  }
+
+  // the first pages are the coldest by now.
+  for(i = 0; i < EXTRA; i += PGSIZE)
+    *(uint64*)(a + n - EXTRA + i) = 0;
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], a + PGSIZE, 8) != 8 || read(fds[0], a + 2*PGSIZE, 8) != 8 ||
+     *(uint64*)(a + 2*PGSIZE) != PGSIZE){
+    printf("%s: pipe of swapped pages failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-n);
+}
+
+// copy through write() and read() while another process
+// keeps memory short, so that the pages copyin() and copyout()
+// use are the ones swapout() wants to take.
+void
+swapcopy(char *s)
+{
+  enum { NPG=48, ROUNDS=30 };
+  uint64 i, n;
+  int fd, pid, r, fds[2];
+  char *a, *b, c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // take all of RAM, then keep touching it until killed.
+    close(fds[0]);
+    a = sbrk(0);
+    for(n = 0; n < PHYSTOP - KERNBASE; n += PGSIZE){
+      if(sbrk(PGSIZE) == (char*)0xffffffffffffffffL)
+        break;
+      a[n] = 1;
+    }
+    write(fds[1], "x", 1);
+    for(;;)
+      for(i = 0; i < n; i += PGSIZE)
+        a[i]++;
+  }
+  close(fds[1]);
+  if(read(fds[0], &c, 1) != 1){
+    printf("%s: memory hog failed\n", s);
+    kill(pid);
+    exit(1);
+  }
+  close(fds[0]);
+
+  a = sbrk(2*NPG*PGSIZE);
+  b = a + NPG*PGSIZE;
+  unlink("swapcopy");
+  fd = open("swapcopy", O_CREATE|O_RDWR);
+  r = fd < 0;
+  for(int round = 0; round < ROUNDS && !r; round++){
+    for(i = 0; i < NPG*PGSIZE; i += PGSIZE)
+      memset(a + i, 'a' + (round + i/PGSIZE) % 26, PGSIZE);
+    if(pwrite(fd, a, NPG*PGSIZE, 0) != NPG*PGSIZE ||
+       pread(fd, b, NPG*PGSIZE, 0) != NPG*PGSIZE ||
+       memcmp(a, b, NPG*PGSIZE) != 0)
+      r = 1;
+  }
+  kill(pid);
+  wait(0);
+  if(r){
+    printf("%s: copy through swapped pages failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("swapcopy");
+  sbrk(-2*NPG*PGSIZE);
+}
+
 // regression test. does the kernel panic if a process sbrk()s its
 // size to be less than a page, or zero, or reduces the break by an
 // amount too small to cause a page to be freed?
@@ -2666,16 +3724,24 @@ main(int argc, char *argv[])
     {fourfiles, "fourfiles"},
     {sharedfd, "sharedfd"},
     {exectest, "exectest"},
+    {spawntest, "spawntest"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
+    {synctest, "synctest"},
     {bsstest, "bsstest"},
     {sbrkbasic, "sbrkbasic"},
     {sbrkmuch, "sbrkmuch"},
+    {sbrkhuge, "sbrkhuge"},
+    {swaptest, "swaptest"},
+    {swapcopy, "swapcopy"},
+    {diskmodes, "diskmodes"},
     {kernmem, "kernmem"},
     {sbrkfail, "sbrkfail"},
     {sbrkarg, "sbrkarg"},
     {validatetest, "validatetest"},
     {stacktest, "stacktest"},
+    {textwrite, "textwrite"},
+    {textbusy, "textbusy"},
     {opentest, "opentest"},
     {writetest, "writetest"},
     {writebig, "writebig"},
@@ -2685,6 +3751,12 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipesize, "pipesize"},
+    {splicetest, "splice"},
+    {sendfiletest, "sendfile"},
+    {preadv, "preadv"},
+    {mmaptest, "mmap"},
+    {mmapio, "mmapio"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -2692,6 +3764,7 @@ main(int argc, char *argv[])
     {bigfile, "bigfile"},
     {dirfile, "dirfile"},
     {iref, "iref"},
+    {manyopen, "manyopen"},
     {forktest, "forktest"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
@@ -36,3 +36,16 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("sync");
+entry("fcntl");
+entry("splice");
+entry("tee");
+entry("sendfile");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("mmap");
+entry("munmap");
+entry("vfork");
+entry("spawn");
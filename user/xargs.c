@@ -47,8 +47,9 @@ int main(int argc, char *argv[])
             {
                 new_argv[p++] = buf + t;
                 new_argv[p] = 0; // 赋值为NULL，避免因为存在多条命令而出错（因为后面的参数可能是上一条命令的，然后就会出错）
-                if (fork() == 0)
-                    exec(new_argv[0], new_argv);
+                // 用spawn直接启动命令，不必为了exec而先fork复制整个地址空间
+                if (spawn(new_argv[0], new_argv, 0) < 0)
+                    fprintf(2, "xargs: cannot run %s\n", new_argv[0]);
                 else
                     wait(0);
                 p = argc - 1; // 处理完'\n'，下一次开始时是全新的命令，要重新定位p